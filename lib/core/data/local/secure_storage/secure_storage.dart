@@ -1,6 +1,8 @@
 import 'dart:convert';
+import 'dart:io';
 
 import 'package:defyx_vpn/core/data/local/secure_storage/flutter_secure_storage_provider.dart';
+import 'package:defyx_vpn/modules/core/vpn_bridge.dart';
 import 'package:flutter/material.dart';
 import 'package:flutter_riverpod/flutter_riverpod.dart';
 import 'package:flutter_secure_storage/flutter_secure_storage.dart';
@@ -14,11 +16,27 @@ final secureStorageProvider = Provider<ISecureStorage>((ref) {
 final class SecureStorage implements ISecureStorage {
   final FlutterSecureStorage _storage;
 
+  // On Linux every flutter_secure_storage call is a keyring round trip, so
+  // entries are served from the runner's in-memory cache instead, which
+  // writes them back to the keyring in the background.
+  final bool _useRunnerCache = Platform.isLinux;
+  final _vpnBridge = VpnBridge();
+
+  // Set in the cache once the entries written before it existed have been
+  // moved over, so later runs skip the keyring lookup.
+  static const _migratedKey = "legacySecretsMigrated";
+  Future<void>? _migration;
+  bool _migrated = false;
+
   SecureStorage(this._storage);
 
   @override
   Future<void> write(String key, String value) async {
     try {
+      if (_useRunnerCache) {
+        await _vpnBridge.writeSecret(key, value);
+        return;
+      }
       await _storage.write(key: key, value: value);
     } catch (e) {
       rethrow;
@@ -29,7 +47,7 @@ final class SecureStorage implements ISecureStorage {
   Future<void> writeMap(String key, Map<String, dynamic> map) async {
     try {
       final jsonString = jsonEncode(map);
-      await _storage.write(key: key, value: jsonString);
+      await write(key, jsonString);
     } catch (e) {
       debugPrint('Error saving map: $e');
       rethrow;
@@ -39,7 +57,7 @@ final class SecureStorage implements ISecureStorage {
   @override
   Future<Map<String, dynamic>> readMap(String key) async {
     try {
-      final jsonString = await _storage.read(key: key);
+      final jsonString = await read(key);
       if (jsonString == null) {
         debugPrint('No data found for key: $key');
         return {};
@@ -56,15 +74,52 @@ final class SecureStorage implements ISecureStorage {
   @override
   Future<String?> read(String key) async {
     try {
+      if (_useRunnerCache) {
+        await (_migration ??= _migrateLegacyEntries());
+        return await _vpnBridge.readSecret(key);
+      }
       return await _storage.read(key: key);
     } catch (e) {
       rethrow;
     }
   }
 
+  // Moves entries written before the cache existed out of
+  // flutter_secure_storage. This only happens once the cache holds what the
+  // keyring had. Before that, a copied entry would count as newer than the
+  // keyring's and be written back over it.
+  Future<void> _migrateLegacyEntries() async {
+    try {
+      if (await _vpnBridge.readSecret(_migratedKey) == null) {
+        if (!await _vpnBridge.isSecretCacheSynced()) {
+          _migration = null;
+          return;
+        }
+
+        final legacy = await _storage.readAll();
+        for (final entry in legacy.entries) {
+          if (await _vpnBridge.readSecret(entry.key) == null) {
+            await _vpnBridge.writeSecret(entry.key, entry.value);
+          }
+          await _storage.delete(key: entry.key);
+        }
+        await _vpnBridge.writeSecret(_migratedKey, "1");
+      }
+      _migrated = true;
+    } catch (e) {
+      debugPrint('Failed to move secure storage entries: $e');
+      _migration = null;
+    }
+  }
+
   @override
   Future<void> delete(String key) async {
     try {
+      if (_useRunnerCache) {
+        await (_migration ??= _migrateLegacyEntries());
+        await _vpnBridge.deleteSecret(key);
+        if (_migrated) return;
+      }
       await _storage.delete(key: key);
     } catch (e) {
       rethrow;
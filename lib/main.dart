@@ -1,18 +1,27 @@
 import 'package:defyx_vpn/firebase_options.dart';
+import 'package:flutter/foundation.dart';
 import 'package:flutter/material.dart';
 import 'package:flutter_riverpod/flutter_riverpod.dart';
 import 'package:flutter/services.dart';
 import 'package:firebase_core/firebase_core.dart';
 import 'package:flutter_dotenv/flutter_dotenv.dart';
+import 'package:defyx_vpn/modules/core/headless_daemon.dart';
 import 'app/app.dart';
 
-void main() async {
+void main(List<String> args) async {
   WidgetsFlutterBinding.ensureInitialized();
   await dotenv.load();
-  await Firebase.initializeApp(
-    name: "defyx-vpn",
-    options: DefaultFirebaseOptions.currentPlatform,
-  );
+  if (args.contains('--headless')) {
+    await HeadlessDaemon(ProviderContainer()).start();
+    return;
+  }
+  // There are no Firebase options for Linux.
+  if (kIsWeb || defaultTargetPlatform != TargetPlatform.linux) {
+    await Firebase.initializeApp(
+      name: "defyx-vpn",
+      options: DefaultFirebaseOptions.currentPlatform,
+    );
+  }
   await SystemChrome.setPreferredOrientations([DeviceOrientation.portraitUp]);
   runApp(const ProviderScope(child: App()));
 }
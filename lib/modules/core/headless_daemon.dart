@@ -0,0 +1,88 @@
+import 'package:defyx_vpn/modules/core/vpn.dart';
+import 'package:defyx_vpn/modules/core/vpn_bridge.dart';
+import 'package:defyx_vpn/shared/providers/connection_state_provider.dart';
+import 'package:flutter/material.dart';
+import 'package:flutter/services.dart';
+import 'package:flutter_riverpod/flutter_riverpod.dart';
+
+// Runs the VPN without UI when the Linux runner is started with --headless.
+// The runner serves a Unix-domain control socket and forwards its commands
+// here; see linux/runner/control_socket.h for the wire format.
+//
+// Only status and disconnect work for now. The Linux runner cannot start a
+// tunnel or measure ping, so connect and ping fail with UNSUPPORTED and the
+// state stays disconnected; this does not run a VPN without a window yet.
+class HeadlessDaemon {
+  HeadlessDaemon(this._container);
+
+  final ProviderContainer _container;
+  final _methodChannel = MethodChannel('com.defyx.daemon');
+  final _vpnBridge = VpnBridge();
+
+  late final VPN _vpn;
+
+  Future<void> start() async {
+    _vpn = VPN(_container);
+    try {
+      await _vpn.initVPN();
+    } catch (e) {
+      debugPrint('Failed to initialize VPN: $e');
+    }
+    _methodChannel.setMethodCallHandler(_handleCommand);
+  }
+
+  Future<int> _handleCommand(MethodCall call) async {
+    switch (call.method) {
+      case 'connect':
+        if (!_vpn.canConnect) {
+          throw PlatformException(
+            code: 'UNSUPPORTED',
+            message: 'This build cannot start a tunnel on Linux',
+          );
+        }
+        await _vpn.connect();
+        return _state();
+      case 'disconnect':
+        await _vpn.disconnect();
+        return _state();
+      case 'status':
+        return _state();
+      case 'ping':
+        final String reply;
+        try {
+          reply = await _vpnBridge.getPing();
+        } on MissingPluginException {
+          throw PlatformException(
+            code: 'UNSUPPORTED',
+            message: 'This build cannot measure ping on Linux',
+          );
+        }
+        final ping = int.tryParse(reply);
+        if (ping == null) {
+          throw PlatformException(code: 'PING_FAILED', message: 'No ping');
+        }
+        return ping;
+      default:
+        throw MissingPluginException();
+    }
+  }
+
+  // Wire values of the control socket's state byte.
+  int _state() {
+    switch (_container.read(connectionStateProvider).status) {
+      case ConnectionStatus.disconnected:
+        return 0;
+      case ConnectionStatus.loading:
+      case ConnectionStatus.analyzing:
+        return 1;
+      case ConnectionStatus.connected:
+        return 2;
+      case ConnectionStatus.disconnecting:
+        return 3;
+      case ConnectionStatus.error:
+        return 4;
+      case ConnectionStatus.noInternet:
+        return 5;
+    }
+  }
+}
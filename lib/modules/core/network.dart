@@ -71,6 +71,7 @@ class NetworkStatus {
         await (Connectivity().checkConnectivity());
 
     return connectivityResult.contains(ConnectivityResult.mobile) ||
-        connectivityResult.contains(ConnectivityResult.wifi);
+        connectivityResult.contains(ConnectivityResult.wifi) ||
+        connectivityResult.contains(ConnectivityResult.ethernet);
   }
 }
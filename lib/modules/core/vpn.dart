@@ -1,4 +1,5 @@
 import 'dart:async';
+import 'dart:convert';
 import 'dart:io';
 
 import 'package:defyx_vpn/app/router/app_router.dart';
@@ -35,6 +36,7 @@ class VPN {
 
   final _vpnBridge = VpnBridge();
   final _eventChannel = EventChannel("com.defyx.progress_events");
+  final _networkEventChannel = EventChannel("com.defyx.network_events");
 
   Stream<String> get vpnUpdates =>
       _eventChannel.receiveBroadcastStream().map((event) => event.toString());
@@ -42,8 +44,21 @@ class VPN {
   bool _initialized = false;
   ProviderContainer? _container;
   StreamSubscription<String>? _vpnSub;
+  StreamSubscription<dynamic>? _networkSub;
   DateTime? _connectionStartTime;
 
+  // Last config the core reported while connecting; used to resume the
+  // tunnel after a network change without walking the whole flowline.
+  String _lastConfigLabel = "";
+  bool _isResuming = false;
+  // Whether the running resume is narrowed to [_lastConfigLabel] and so
+  // falls back to the full flowline if it fails.
+  bool _resumedOnLabel = false;
+
+  // Tunnel MTU last probed for each connection method, used as the starting
+  // point the next time the same method connects.
+  final Map<String, int> _probedMtu = {};
+
   void _init(ProviderContainer container) {
     if (_initialized) return;
     _initialized = true;
@@ -59,10 +74,16 @@ class VPN {
     vpnUpdates.listen((msg) {
       _handleVPNUpdates(msg);
     });
+    if (_hasLinuxTunnel) {
+      _networkSub = _networkEventChannel
+          .receiveBroadcastStream()
+          .listen((_) => _onNetworkChanged());
+    }
   }
 
   void dispose() {
     _vpnSub?.cancel();
+    _networkSub?.cancel();
   }
 
   void _loadChangeRootListener() {
@@ -92,22 +113,31 @@ class VPN {
     }
 
     if (msg.startsWith("Data: VPN connected")) {
+      _isResuming = false;
       _onSuccessConnect();
     }
     if (msg.startsWith("Data: VPN failed")) {
-      _onFailerConnect();
+      if (_isResuming && _resumedOnLabel) {
+        _resumedOnLabel = false;
+        _startFullFlow();
+      } else {
+        _isResuming = false;
+        _onFailerConnect();
+      }
     }
-    if (msg.startsWith("Data: VPN cancelled")) {
+    // While resuming, stop events come from the core stopped for the resume.
+    if (msg.startsWith("Data: VPN cancelled") && !_isResuming) {
       _closeTunnel();
     }
     if (msg.startsWith("Data: VPN group failed")) {
       loggerNotifier.setSwitchingMethod();
     }
-    if (msg.startsWith("Data: VPN stopped")) {
+    if (msg.startsWith("Data: VPN stopped") && !_isResuming) {
       _closeTunnel();
     }
     if (msg.startsWith("Data: Config label: ")) {
       final configLabel = msg.replaceAll("Data: Config label: ", "");
+      _lastConfigLabel = configLabel;
       _vpnBridge.setConnectionMethod(configLabel);
       groupNotifier.setGroupName(configLabel);
     }
@@ -128,18 +158,17 @@ class VPN {
     final connectionNotifier =
         _container?.read(connectionStateProvider.notifier);
     final loggerNotifier = _container?.read(loggerStateProvider.notifier);
-    final settings = _container?.read(settingsProvider.notifier);
 
     _setConnectionStep(1);
 
-    WidgetsBinding.instance.addPostFrameCallback((_) {
+    _afterFrame(() {
       connectionNotifier?.setLoading();
     });
 
-    WidgetsBinding.instance.addPostFrameCallback((_) {
+    _afterFrame(() {
       connectionNotifier?.setAnalyzing();
     });
-    WidgetsBinding.instance.addPostFrameCallback((_) {
+    _afterFrame(() {
       loggerNotifier?.setLoading();
     });
 
@@ -159,6 +188,11 @@ class VPN {
       return;
     }
 
+    await _startFullFlow();
+  }
+
+  Future<void> _startFullFlow() async {
+    final settings = _container?.read(settingsProvider.notifier);
     final flowLineStorage =
         await _container?.read(secureStorageProvider).read('flowLine') ?? "";
 
@@ -170,11 +204,66 @@ class VPN {
     await _vpnBridge.startVPN(flowLineStorage, pattern);
   }
 
+  // Called by the Linux runner once the physical network has settled after a
+  // link or default-route change. Retries the last working config first and
+  // only falls back to the full flowline if that fails.
+  Future<void> _onNetworkChanged() async {
+    final connectionNotifier =
+        _container?.read(connectionStateProvider.notifier);
+    final connectionState = _container?.read(connectionStateProvider);
+    if (connectionState?.status != ConnectionStatus.connected ||
+        _lastConfigLabel.isEmpty ||
+        _isResuming) {
+      return;
+    }
+
+    final networkIsConnected = await NetworkStatus.checkConnectivity();
+    if (!networkIsConnected) {
+      return;
+    }
+
+    _isResuming = true;
+    _cancelMtuProbe();
+    connectionNotifier?.setAnalyzing();
+
+    final flowLineStorage =
+        await _container?.read(secureStorageProvider).read('flowLine') ?? "";
+    _resumedOnLabel = _flowLineHasLabel(flowLineStorage, _lastConfigLabel);
+
+    // The old core is still bound to the previous network.
+    await _vpnBridge.stopVPN();
+
+    if (!_resumedOnLabel) {
+      log.addLog("[INFO] Network changed, $_lastConfigLabel is not in the "
+          "flowline; running the full flowline");
+      await _startFullFlow();
+      return;
+    }
+    log.addLog("[INFO] Network changed, resuming on $_lastConfigLabel");
+    _connectionStartTime = DateTime.now();
+    await _vpnBridge.startVPN(flowLineStorage, _lastConfigLabel);
+  }
+
+  // A pattern is a comma-separated list of flowline labels, which is what
+  // settings item ids are built from, and the core reports the label of the
+  // config it connected with. A single label therefore narrows the flowline
+  // to that config, provided the stored flowline still has it enabled.
+  bool _flowLineHasLabel(String flowLine, String label) {
+    try {
+      final List<dynamic> items = json.decode(flowLine);
+      return items
+          .any((item) => item['label'] == label && item['enabled'] == true);
+    } catch (_) {
+      return false;
+    }
+  }
+
   Future<void> _onFailerConnect() async {
     final connectionNotifier =
         _container?.read(connectionStateProvider.notifier);
 
     connectionNotifier?.setError();
+    _recordConnectionAttempt(succeeded: false);
     await _vpnBridge.disconnectVpn();
     vibrationService.vibrateError();
   }
@@ -198,6 +287,9 @@ class VPN {
     final groupState = _container?.read(groupStateProvider);
     final pattern = settings?.getPattern() ?? "auto";
 
+    _recordConnectionAttempt(succeeded: true);
+    _tuneMtu();
+
     int connectionDuration = 0;
     if (_connectionStartTime != null) {
       connectionDuration =
@@ -211,6 +303,43 @@ class VPN {
     await _container?.read(flowlineServiceProvider).saveFlowline();
   }
 
+  void _recordConnectionAttempt({required bool succeeded}) {
+    if (!_hasLinuxTunnel || _connectionStartTime == null) return;
+
+    final groupState = _container?.read(groupStateProvider);
+    final connectMs =
+        DateTime.now().difference(_connectionStartTime!).inMilliseconds;
+    _vpnBridge.recordHistory({
+      "method": groupState?.groupName ?? "",
+      if (succeeded) "connectMs": connectMs,
+    }).catchError((e) => debugPrint('Failed to record connection: $e'));
+  }
+
+  Future<void> _tuneMtu() async {
+    if (!_hasLinuxTunnel) return;
+
+    final method = _container?.read(groupStateProvider).groupName ?? "";
+    try {
+      final result = await _vpnBridge.probeMtu(hint: _probedMtu[method] ?? 0);
+      final mtu = result["mtu"] as int? ?? 0;
+      if (mtu > 0) _probedMtu[method] = mtu;
+      final applied = result["applied"] == true ? "set to" : "probed at";
+      log.addLog("[INFO] Tunnel MTU for $method $applied $mtu, "
+          "MSS ${result["mss"]}");
+    } catch (e) {
+      debugPrint('MTU probe failed: $e');
+    }
+  }
+
+  // A probe must not outlive the tunnel it is retuning.
+  void _cancelMtuProbe() {
+    if (!_hasLinuxTunnel) return;
+
+    _vpnBridge
+        .cancelMtuProbe()
+        .catchError((e) => debugPrint('Failed to cancel MTU probe: $e'));
+  }
+
   Future<void> refreshPing() async {
     _container?.read(pingLoadingProvider.notifier).state = true;
     _container?.read(flagLoadingProvider.notifier).state = true;
@@ -218,22 +347,26 @@ class VPN {
     _container?.read(pingLoadingProvider.notifier).state = false;
   }
 
-  Future<void> _stopVPN(WidgetRef ref) async {
-    final connectionNotifier = ref.read(connectionStateProvider.notifier);
-    connectionNotifier.setDisconnecting();
+  Future<void> _stopVPN() async {
+    final connectionNotifier =
+        _container?.read(connectionStateProvider.notifier);
+    connectionNotifier?.setDisconnecting();
+    _cancelMtuProbe();
     await _vpnBridge.stopVPN();
-    _clearData(ref);
-    connectionNotifier.setDisconnected();
+    _clearData();
+    connectionNotifier?.setDisconnected();
   }
 
-  Future<void> _disconnect(WidgetRef ref) async {
-    final connectionNotifier = ref.read(connectionStateProvider.notifier);
+  Future<void> _disconnect() async {
+    final connectionNotifier =
+        _container?.read(connectionStateProvider.notifier);
     final vpnData = await _container?.read(vpnDataProvider.future);
-    connectionNotifier.setDisconnecting();
+    connectionNotifier?.setDisconnecting();
+    _cancelMtuProbe();
     await _vpnBridge.disconnectVpn();
-    _clearData(ref);
+    _clearData();
     vpnData?.disableVPN();
-    connectionNotifier.setDisconnected();
+    connectionNotifier?.setDisconnected();
     analyticsService.logVpnDisconnected();
   }
 
@@ -242,6 +375,7 @@ class VPN {
         _container?.read(connectionStateProvider.notifier);
     final vpnData = await _container?.read(vpnDataProvider.future);
     connectionNotifier?.setDisconnecting();
+    _cancelMtuProbe();
     if (Platform.isIOS) {
       await _vpnBridge.disconnectVpn();
     }
@@ -254,12 +388,21 @@ class VPN {
     final connectionNotifier =
         _container?.read(connectionStateProvider.notifier);
     connectionNotifier?.setDisconnecting();
+    _cancelMtuProbe();
     final vpnData = await _container?.read(vpnDataProvider.future);
     await _vpnBridge.stopVPN();
     await vpnData?.disableVPN();
     connectionNotifier?.setDisconnected();
   }
 
+  // Whether this platform has a way to start the tunnel; the Linux runner
+  // has no VPN permission flow or datapath yet.
+  bool get canConnect => Platform.isAndroid || Platform.isIOS;
+
+  // The Linux-only hooks that act on a running tunnel stay off until the
+  // Linux runner can start one.
+  bool get _hasLinuxTunnel => Platform.isLinux && canConnect;
+
   Future<bool?> _grantVpnPermission() async {
     switch (Platform.operatingSystem) {
       case 'android':
@@ -283,6 +426,16 @@ class VPN {
   }
 
 
+  // Defers state changes made from a tap until the frame being built is
+  // done. Headless runs have no widget tree to wait for.
+  void _afterFrame(VoidCallback callback) {
+    if (WidgetsBinding.instance.rootElement == null) {
+      callback();
+      return;
+    }
+    WidgetsBinding.instance.addPostFrameCallback((_) => callback());
+  }
+
   void _setConnectionStep(int step) {
     _container?.read(flowLineStepProvider.notifier).setStep(step);
   }
@@ -291,9 +444,12 @@ class VPN {
     _container?.read(flowLineStepProvider.notifier).setTotalSteps(totalSteps);
   }
 
-  void _clearData(WidgetRef ref) {
-    final groupNotifier = ref.read(groupStateProvider.notifier);
-    groupNotifier.setGroupName("");
+  void _clearData() {
+    final groupNotifier = _container?.read(groupStateProvider.notifier);
+    groupNotifier?.setGroupName("");
+    _lastConfigLabel = "";
+    _isResuming = false;
+    _resumedOnLabel = false;
     _setConnectionTotalSteps(0);
     _setConnectionStep(0);
   }
@@ -302,14 +458,25 @@ class VPN {
     final connectionState = ref.read(connectionStateProvider);
     switch (connectionState.status) {
       case ConnectionStatus.connected:
-        await _disconnect(ref);
-        return;
       case ConnectionStatus.loading:
       case ConnectionStatus.analyzing:
-        await _stopVPN(ref);
+        await disconnect();
         return;
       case ConnectionStatus.disconnected:
       case ConnectionStatus.error:
+      case ConnectionStatus.noInternet:
+        await connect();
+        return;
+      default:
+        break;
+    }
+  }
+
+  // Starts connecting unless a connection is already up or in progress.
+  Future<void> connect() async {
+    switch (_container?.read(connectionStateProvider).status) {
+      case ConnectionStatus.disconnected:
+      case ConnectionStatus.error:
       case ConnectionStatus.noInternet:
         await _connect();
         return;
@@ -318,6 +485,21 @@ class VPN {
     }
   }
 
+  // Tears down the connection, or cancels one that is still being set up.
+  Future<void> disconnect() async {
+    switch (_container?.read(connectionStateProvider).status) {
+      case ConnectionStatus.connected:
+        await _disconnect();
+        return;
+      case ConnectionStatus.loading:
+      case ConnectionStatus.analyzing:
+        await _stopVPN();
+        return;
+      default:
+        break;
+    }
+  }
+
   Future<void> getVPNStatus() async {
     final connectionNotifier =
         _container?.read(connectionStateProvider.notifier);
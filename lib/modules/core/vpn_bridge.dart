@@ -60,6 +60,60 @@ class VpnBridge {
     return result ?? false;
   }
 
+  /// Appends a row to the on-device history (Linux only). Missing fields are
+  /// stored as absent and skipped by [getHistorySummary].
+  Future<void> recordHistory(Map<String, dynamic> record) =>
+      _methodChannel.invokeMethod("recordHistory", record);
+
+  /// Aggregates the history rows recorded between [from] and [to], optionally
+  /// only those recorded with connection [method] (Linux only).
+  Future<Map<String, dynamic>> getHistorySummary(DateTime from, DateTime to,
+      {String method = ""}) async {
+    final summary = await _methodChannel.invokeMapMethod<String, dynamic>(
+      "getHistorySummary",
+      {
+        "from": from.millisecondsSinceEpoch,
+        "to": to.millisecondsSinceEpoch,
+        "method": method,
+      },
+    );
+    return summary ?? {};
+  }
+
+  /// Finds the largest packet the tunnel carries and retunes the tunnel
+  /// interface MTU, and with it the TCP MSS, to match (Linux only). Sizes
+  /// above the current MTU are only probed, and the result only applied, when
+  /// the runner has CAP_NET_ADMIN. [hint] is the result of an earlier probe
+  /// over the same connection method.
+  Future<Map<String, dynamic>> probeMtu({int hint = 0}) async {
+    final result = await _methodChannel
+        .invokeMapMethod<String, dynamic>("probeMtu", {"hint": hint});
+    return result ?? {};
+  }
+
+  /// Stops a running [probeMtu], which then fails, before the tunnel it
+  /// probes goes away (Linux only).
+  Future<void> cancelMtuProbe() =>
+      _methodChannel.invokeMethod("cancelMtuProbe");
+
+  /// Reads [key] from the runner's secret cache (Linux only); null if the
+  /// cache does not hold it.
+  Future<String?> readSecret(String key) =>
+      _methodChannel.invokeMethod<String>("readSecret", {"key": key});
+
+  Future<void> writeSecret(String key, String value) => _methodChannel
+      .invokeMethod("writeSecret", {"key": key, "value": value});
+
+  Future<void> deleteSecret(String key) =>
+      _methodChannel.invokeMethod("deleteSecret", {"key": key});
+
+  /// Whether the runner's secret cache holds what the keyring had; false if
+  /// the keyring could not be read this session.
+  Future<bool> isSecretCacheSynced() async {
+    return await _methodChannel.invokeMethod<bool>("isSecretCacheSynced") ??
+        false;
+  }
+
   Future<bool> isVPNPrepared() async {
     return await _methodChannel.invokeMethod<bool>('isVPNPrepared') ?? false;
   }
@@ -0,0 +1,104 @@
+import 'dart:math';
+import 'speed_measurement_config.dart';
+
+/// Decides the transfer size and stream count of each throughput sample.
+///
+/// Starts small and grows the transfer until a sample lasts long enough for
+/// TCP to leave slow start, then adds parallel streams until throughput stops
+/// improving. The phase ends when the estimate has converged or its time
+/// budget is spent, so slow links do not sit through large transfers and fast
+/// links are not measured with samples that finish during slow start.
+class AdaptiveMeasurementScheduler {
+  final Duration budget;
+  final int maxBytes;
+  final Stopwatch _clock = Stopwatch();
+
+  int _bytes;
+  int _streams = 1;
+  bool _converged = false;
+  double _bestAtCurrentStreams = 0.0;
+  double _bestBeforeMoreStreams = 0.0;
+  int _flatSamples = 0;
+
+  /// Samples long enough to be trusted as a throughput estimate, in Mbps.
+  final List<double> steadySamples = [];
+
+  /// Every sample taken, including the short ones used to size transfers.
+  final List<double> allSamples = [];
+
+  AdaptiveMeasurementScheduler({
+    required this.budget,
+    required int initialBytes,
+    required this.maxBytes,
+  }) : _bytes = initialBytes;
+
+  int get bytes => _bytes;
+  int get streams => _streams;
+  bool get converged => _converged;
+
+  /// Fraction of the phase done, for the progress arc.
+  double get progress {
+    if (_converged) return 1.0;
+    return (_clock.elapsedMilliseconds / budget.inMilliseconds).clamp(0.0, 1.0);
+  }
+
+  /// Samples to report as the result of the phase.
+  List<double> get resultSamples =>
+      steadySamples.isNotEmpty ? steadySamples : allSamples;
+
+  /// Whether another sample should be taken.
+  bool get hasNext {
+    if (!_clock.isRunning) _clock.start();
+    return !_converged && _clock.elapsed < budget;
+  }
+
+  /// Time left in the budget; a sample still running after it is cancelled.
+  Duration get remaining {
+    final left = budget - _clock.elapsed;
+    return left.isNegative ? Duration.zero : left;
+  }
+
+  /// Records a sample of [mbps] that took [elapsed] with the current
+  /// transfer size and stream count, and picks the next one.
+  void record(double mbps, Duration elapsed) {
+    allSamples.add(mbps);
+
+    if (elapsed < SpeedMeasurementConfig.minSampleDuration &&
+        _bytes < maxBytes) {
+      // Too short to have left slow start: scale the transfer so the next
+      // sample lands around the target duration, but never shrink it. Only
+      // a sample already taken at the largest transfer is kept regardless.
+      final target = SpeedMeasurementConfig.targetSampleDuration.inMilliseconds;
+      final scale = target / max(elapsed.inMilliseconds, 1);
+      final grown = (_bytes * scale.clamp(2.0, 8.0)).round();
+      _bytes = min(grown, maxBytes);
+      return;
+    }
+
+    steadySamples.add(mbps);
+
+    final threshold = SpeedMeasurementConfig.plateauThreshold;
+    if (mbps > _bestAtCurrentStreams * (1 + threshold)) {
+      _bestAtCurrentStreams = mbps;
+      _flatSamples = 0;
+      return;
+    }
+
+    _bestAtCurrentStreams = max(_bestAtCurrentStreams, mbps);
+    _flatSamples++;
+    if (_flatSamples < SpeedMeasurementConfig.plateauSamples) return;
+
+    // Throughput has plateaued at this stream count. More streams only help
+    // if a single flow cannot fill the path; stop once they stop helping.
+    final gained =
+        _bestAtCurrentStreams > _bestBeforeMoreStreams * (1 + threshold);
+    if (_streams >= SpeedMeasurementConfig.maxStreams || !gained) {
+      _converged = true;
+      return;
+    }
+
+    _bestBeforeMoreStreams = _bestAtCurrentStreams;
+    _streams *= 2;
+    _flatSamples = 0;
+  }
+}
@@ -18,6 +18,8 @@ class CloudflareLoggerService {
         'uploadMbps': result.uploadSpeed,
         'latencyMs': result.latency,
         'jitterMs': result.jitter,
+        'loadedLatencyMs': result.loadedLatency,
+        'bufferbloatMs': result.bufferbloat,
         'packetLossPercent': result.packetLoss,
         'timestamp': DateTime.now().toIso8601String(),
         'client': 'DefyxVPN-Flutter',
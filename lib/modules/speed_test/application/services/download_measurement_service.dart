@@ -1,3 +1,4 @@
+import 'package:dio/dio.dart';
 import 'package:flutter/foundation.dart';
 import '../../data/api/speed_test_api.dart';
 import 'speed_measurement_config.dart';
@@ -14,6 +15,11 @@ class DownloadMeasurementService {
   final List<double> downloadSpeeds = [];
   final List<int> latencies;
 
+  /// Wall-clock duration of the last completed sample.
+  Duration lastSampleDuration = Duration.zero;
+
+  CancelToken? _sampleCancelToken;
+
   DownloadMeasurementService({
     required this.api,
     required this.measurementId,
@@ -26,6 +32,7 @@ class DownloadMeasurementService {
   Future<void> runMeasurement(Map<String, dynamic> config) async {
     final bytes = config['bytes'] as int;
     final count = config['count'] as int;
+    final streams = config['streams'] as int? ?? 1;
     final sizeLabel = SpeedMeasurementConfig.formatBytes(bytes);
     int consecutiveFailures = 0;
 
@@ -36,7 +43,7 @@ class DownloadMeasurementService {
       }
 
       try {
-        final speed = await _measureSpeed(bytes);
+        final speed = await _measureSpeed(bytes, streams);
         if (speed > 0) {
           downloadSpeeds.add(speed);
           consecutiveFailures = 0;
@@ -60,7 +67,7 @@ class DownloadMeasurementService {
           onMetricsUpdate(percentileSpeed, avgSpeed, currentPing, avgLatency, jitter);
 
           debugPrint(
-              '   📥 Download ${i + 1}/$count ($sizeLabel): ${speed.toStringAsFixed(2)} Mbps (90th percentile: ${percentileSpeed.toStringAsFixed(2)} Mbps, Avg: ${avgSpeed.toStringAsFixed(2)} Mbps)');
+              '   📥 Download ${i + 1}/$count ($sizeLabel x$streams): ${speed.toStringAsFixed(2)} Mbps (90th percentile: ${percentileSpeed.toStringAsFixed(2)} Mbps, Avg: ${avgSpeed.toStringAsFixed(2)} Mbps)');
         }
       } catch (e) {
         consecutiveFailures++;
@@ -75,35 +82,48 @@ class DownloadMeasurementService {
     }
   }
 
-  Future<double> _measureSpeed(int bytes) async {
+  /// Aborts the sample in flight, which then records nothing.
+  void cancelSample() => _sampleCancelToken?.cancel();
+
+  Future<double> _measureSpeed(int bytes, int streams) async {
     if (isCanceledCheck(false)) {
       debugPrint('   🛑 Download measurement canceled before start');
       return 0.0;
     }
 
+    final cancelToken = CancelToken();
+    _sampleCancelToken = cancelToken;
+
     try {
       final startTime = DateTime.now();
       DateTime? lastUpdateTime;
-
-      final response = await api.downloadTest(
-        bytes: bytes,
-        measurementId: measurementId,
-        during: 'download',
-        onReceiveProgress: (received, total) {
-          final now = DateTime.now();
-          final elapsed = now.difference(startTime).inMilliseconds / 1000.0;
-
-          if (!isCanceledCheck(false) &&
-              elapsed > 0.05 &&
-              (lastUpdateTime == null || now.difference(lastUpdateTime!).inMilliseconds > 100)) {
-            final currentSpeedBps = (received * 8) / elapsed;
-            final currentSpeedMbps = currentSpeedBps / 1000000;
-            final roundedSpeed = SpeedMeasurementConfig.roundSpeed(currentSpeedMbps);
-            onSpeedUpdate(roundedSpeed);
-            lastUpdateTime = now;
-          }
-        },
-      );
+      final receivedPerStream = List<int>.filled(streams, 0);
+
+      final responses = await Future.wait(List.generate(
+        streams,
+        (stream) => api.downloadTest(
+          bytes: bytes,
+          measurementId: measurementId,
+          during: 'download',
+          cancelToken: cancelToken,
+          onReceiveProgress: (count, total) {
+            receivedPerStream[stream] = count;
+            final received = receivedPerStream.reduce((a, b) => a + b);
+            final now = DateTime.now();
+            final elapsed = now.difference(startTime).inMilliseconds / 1000.0;
+
+            if (!isCanceledCheck(false) &&
+                elapsed > 0.05 &&
+                (lastUpdateTime == null || now.difference(lastUpdateTime!).inMilliseconds > 100)) {
+              final currentSpeedBps = (received * 8) / elapsed;
+              final currentSpeedMbps = currentSpeedBps / 1000000;
+              final roundedSpeed = SpeedMeasurementConfig.roundSpeed(currentSpeedMbps);
+              onSpeedUpdate(roundedSpeed);
+              lastUpdateTime = now;
+            }
+          },
+        ),
+      ));
 
       if (isCanceledCheck(false)) {
         debugPrint('   🛑 Download measurement canceled after completion');
@@ -111,17 +131,23 @@ class DownloadMeasurementService {
       }
 
       final duration = DateTime.now().difference(startTime);
+      lastSampleDuration = duration;
       final durationSeconds = duration.inMilliseconds / 1000.0;
 
       if (durationSeconds < 0.01) return 0.0;
 
-      final actualBytes = response.data.length;
+      final actualBytes =
+          responses.fold<int>(0, (sum, response) => sum + response.data.length);
       final bits = actualBytes * 8;
       final bps = bits / durationSeconds;
       final mbps = bps / 1000000;
 
       return mbps;
     } catch (e) {
+      if (e is DioException && CancelToken.isCancel(e)) {
+        debugPrint('   🛑 Download sample canceled in flight');
+        return 0.0;
+      }
       debugPrint('   ❌ Download measurement error: $e');
       throw Exception('Download failed: $e');
     }
@@ -6,6 +6,7 @@ class ResultsCalculatorService {
     required List<double> uploadSpeeds,
     required List<int> latencies,
     required List<Map<String, dynamic>> measurements,
+    List<int> loadedLatencies = const [],
   }) {
     final finalDownloadSpeed = _calculatePercentile(downloadSpeeds, 0.9);
     final finalUploadSpeed = _calculatePercentile(uploadSpeeds, 0.9);
@@ -13,6 +14,8 @@ class ResultsCalculatorService {
     final ping = latencies.isNotEmpty ? latencies.reduce((a, b) => a < b ? a : b) : 0;
 
     final latency = _calculatePercentile(latencies.map((e) => e.toDouble()).toList(), 0.5).round();
+    final loadedLatency =
+        _calculatePercentile(loadedLatencies.map((e) => e.toDouble()).toList(), 0.5).round();
 
     int jitter = 0;
     if (latencies.length >= 2) {
@@ -40,6 +43,7 @@ class ResultsCalculatorService {
       latency: latency,
       jitter: jitter,
       packetLoss: packetLoss,
+      loadedLatency: loadedLatency,
     );
   }
 
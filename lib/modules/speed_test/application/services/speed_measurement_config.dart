@@ -3,14 +3,25 @@ class SpeedMeasurementConfig {
     {'type': 'latency', 'numPackets': 1},
     {'type': 'download', 'bytes': 100000, 'count': 1, 'bypassMinDuration': true},
     {'type': 'latency', 'numPackets': 20},
-    {'type': 'download', 'bytes': 100000, 'count': 9},
-    {'type': 'download', 'bytes': 1000000, 'count': 8},
-    {'type': 'upload', 'bytes': 100000, 'count': 8},
-    {'type': 'upload', 'bytes': 1000000, 'count': 6},
-    {'type': 'download', 'bytes': 10000000, 'count': 6},
+    {'type': 'download', 'adaptive': true},
+    {'type': 'upload', 'adaptive': true},
   ];
 
-  static const int totalMeasurements = 8;
+  static const int totalMeasurements = 5;
+
+  // Adaptive throughput phases, see AdaptiveMeasurementScheduler.
+  static const Duration downloadBudget = Duration(seconds: 12);
+  static const Duration uploadBudget = Duration(seconds: 8);
+  static const int initialTransferBytes = 100000;
+  static const int maxDownloadBytes = 50000000;
+  static const int maxUploadBytes = 25000000;
+  static const int maxStreams = 4;
+  static const Duration minSampleDuration = Duration(milliseconds: 1000);
+  static const Duration targetSampleDuration = Duration(milliseconds: 2000);
+  static const double plateauThreshold = 0.05;
+  static const int plateauSamples = 2;
+  static const Duration loadedLatencyInterval = Duration(milliseconds: 250);
+
   static const int maxConsecutiveFailures = 3;
   static const int chunkSize = 65536;
   static const Duration measurementDelay = Duration(milliseconds: 50);
@@ -1,5 +1,6 @@
 import 'dart:async';
 import 'dart:math';
+import 'package:dio/dio.dart';
 import 'package:flutter/foundation.dart';
 import '../../data/api/speed_test_api.dart';
 import 'speed_measurement_config.dart';
@@ -16,6 +17,11 @@ class UploadMeasurementService {
   final List<int> latencies;
   final List<Map<String, dynamic>> measurements;
 
+  /// Wall-clock duration of the last completed sample.
+  Duration lastSampleDuration = Duration.zero;
+
+  CancelToken? _sampleCancelToken;
+
   UploadMeasurementService({
     required this.api,
     required this.measurementId,
@@ -29,6 +35,7 @@ class UploadMeasurementService {
   Future<void> runMeasurement(Map<String, dynamic> config) async {
     final bytes = config['bytes'] as int;
     final count = config['count'] as int;
+    final streams = config['streams'] as int? ?? 1;
     final sizeLabel = SpeedMeasurementConfig.formatBytes(bytes);
     int consecutiveFailures = 0;
 
@@ -39,7 +46,7 @@ class UploadMeasurementService {
       }
 
       try {
-        final speed = await _measureSpeed(bytes);
+        final speed = await _measureSpeed(bytes, streams);
         if (speed > 0 && !isCanceledCheck(false)) {
           uploadSpeeds.add(speed);
           consecutiveFailures = 0;
@@ -68,7 +75,7 @@ class UploadMeasurementService {
           onMetricsUpdate(percentileSpeed, avgSpeed, jitter, packetLoss);
 
           debugPrint(
-              '   📤 Upload ${i + 1}/$count ($sizeLabel): ${speed.toStringAsFixed(2)} Mbps (90th percentile: ${percentileSpeed.toStringAsFixed(2)} Mbps, Avg: ${avgSpeed.toStringAsFixed(2)} Mbps)');
+              '   📤 Upload ${i + 1}/$count ($sizeLabel x$streams): ${speed.toStringAsFixed(2)} Mbps (90th percentile: ${percentileSpeed.toStringAsFixed(2)} Mbps, Avg: ${avgSpeed.toStringAsFixed(2)} Mbps)');
         }
       } catch (e) {
         consecutiveFailures++;
@@ -83,87 +90,104 @@ class UploadMeasurementService {
     }
   }
 
-  Future<double> _measureSpeed(int bytes) async {
+  /// Aborts the sample in flight, which then records nothing.
+  void cancelSample() => _sampleCancelToken?.cancel();
+
+  Future<double> _measureSpeed(int bytes, int streams) async {
     if (isCanceledCheck(false)) {
       debugPrint('   🛑 Upload measurement canceled before start');
       return 0.0;
     }
 
+    final cancelToken = CancelToken();
+    _sampleCancelToken = cancelToken;
+
     try {
       final startTime = DateTime.now();
       DateTime? lastUpdateTime;
-      final completer = Completer<double>();
-
-      final streamController = StreamController<List<int>>();
-      int sentBytes = 0;
-
-      Future.microtask(() async {
-        final random = Random();
-        while (sentBytes < bytes) {
-          if (streamController.isClosed) break;
-          final remaining = bytes - sentBytes;
-          final size = min(SpeedMeasurementConfig.chunkSize, remaining);
-          final chunk = List<int>.generate(size, (_) => random.nextInt(256));
-          streamController.add(chunk);
-          sentBytes += size;
-          await Future.delayed(const Duration(microseconds: 1));
-        }
-        await streamController.close();
-      });
+      final sentPerStream = List<int>.filled(streams, 0);
 
-      api.uploadTest(
-        streamController.stream,
-        contentLength: bytes,
-        measurementId: measurementId,
-        during: 'upload',
-        onSendProgress: (sent, total) {
+      await Future.wait(List.generate(
+        streams,
+        (stream) => _uploadStream(bytes, cancelToken, (sent) {
+          sentPerStream[stream] = sent;
+          final totalSent = sentPerStream.reduce((a, b) => a + b);
           final now = DateTime.now();
           final elapsed = now.difference(startTime).inMilliseconds / 1000.0;
 
           if (!isCanceledCheck(false) &&
               elapsed > 0.05 &&
               (lastUpdateTime == null || now.difference(lastUpdateTime!).inMilliseconds > 100)) {
-            final currentSpeedBps = (sent * 8) / elapsed;
+            final currentSpeedBps = (totalSent * 8) / elapsed;
             final currentSpeedMbps = currentSpeedBps / 1000000;
             final roundedSpeed = SpeedMeasurementConfig.roundSpeed(currentSpeedMbps);
             onSpeedUpdate(roundedSpeed);
             lastUpdateTime = now;
           }
-        },
-      ).then((_) {
-        if (isCanceledCheck(false)) {
-          debugPrint('   🛑 Upload measurement canceled after completion');
-          completer.complete(0.0);
-          return;
-        }
+        }),
+      ));
 
-        final duration = DateTime.now().difference(startTime);
-        final durationSeconds = duration.inMilliseconds / 1000.0;
+      if (isCanceledCheck(false)) {
+        debugPrint('   🛑 Upload measurement canceled after completion');
+        return 0.0;
+      }
 
-        if (durationSeconds < 0.01) {
-          completer.complete(0.0);
-          return;
-        }
+      final duration = DateTime.now().difference(startTime);
+      lastSampleDuration = duration;
+      final durationSeconds = duration.inMilliseconds / 1000.0;
 
-        final bits = bytes * 8;
-        final bps = bits / durationSeconds;
-        final mbps = bps / 1000000;
-        completer.complete(mbps);
-      }).catchError((e) {
-        debugPrint('   ❌ Upload measurement error: $e');
-        if (!streamController.isClosed) {
-          streamController.close();
-        }
-        completer.completeError(Exception('Upload failed: $e'));
-      });
+      if (durationSeconds < 0.01) return 0.0;
 
-      return completer.future;
+      final bits = bytes * streams * 8;
+      final bps = bits / durationSeconds;
+      final mbps = bps / 1000000;
+      return mbps;
     } catch (e) {
+      if (e is DioException && CancelToken.isCancel(e)) {
+        debugPrint('   🛑 Upload sample canceled in flight');
+        return 0.0;
+      }
       debugPrint('   ❌ Upload measurement error: $e');
       throw Exception('Upload failed: $e');
     }
   }
 
+  Future<void> _uploadStream(
+      int bytes, CancelToken cancelToken, void Function(int sent) onSent) async {
+    final streamController = StreamController<List<int>>();
+    int sentBytes = 0;
+
+    Future.microtask(() async {
+      final random = Random();
+      while (sentBytes < bytes) {
+        if (streamController.isClosed) break;
+        final remaining = bytes - sentBytes;
+        final size = min(SpeedMeasurementConfig.chunkSize, remaining);
+        final chunk = List<int>.generate(size, (_) => random.nextInt(256));
+        streamController.add(chunk);
+        sentBytes += size;
+        await Future.delayed(const Duration(microseconds: 1));
+      }
+      await streamController.close();
+    });
+
+    try {
+      await api.uploadTest(
+        streamController.stream,
+        contentLength: bytes,
+        measurementId: measurementId,
+        during: 'upload',
+        cancelToken: cancelToken,
+        onSendProgress: (sent, total) => onSent(sent),
+      );
+    } catch (e) {
+      if (!streamController.isClosed) {
+        streamController.close();
+      }
+      rethrow;
+    }
+  }
+
   double _calculatePercentile(List<double> values, double percentile) {
     if (values.isEmpty) return 0.0;
 
@@ -1,13 +1,18 @@
 import 'dart:async';
+import 'dart:io';
 import 'dart:math';
 import 'package:defyx_vpn/core/network/http_client.dart';
 import 'package:defyx_vpn/core/network/http_client_interface.dart';
+import 'package:defyx_vpn/modules/core/log.dart';
+import 'package:defyx_vpn/modules/core/vpn_bridge.dart';
 import 'package:defyx_vpn/modules/speed_test/data/api/speed_test_api.dart';
 import 'package:defyx_vpn/modules/speed_test/models/speed_test_result.dart';
 import 'package:defyx_vpn/shared/providers/connection_state_provider.dart';
+import 'package:defyx_vpn/shared/providers/group_provider.dart';
 import 'package:defyx_vpn/shared/services/vibration_service.dart';
 import 'package:flutter/foundation.dart';
 import 'package:flutter_riverpod/flutter_riverpod.dart';
+import 'services/adaptive_measurement_scheduler.dart';
 import 'services/cloudflare_logger_service.dart';
 import 'services/download_measurement_service.dart';
 import 'services/latency_measurement_service.dart';
@@ -85,6 +90,8 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
   final List<double> _downloadSpeeds = [];
   final List<double> _uploadSpeeds = [];
   final List<int> _latencies = [];
+  final List<int> _loadedLatencies = [];
+  bool _isProbingLoadedLatency = false;
 
   SpeedTestNotifier(this._httpClient, this._ref) : super(const SpeedTestState()) {
     final dio = (_httpClient as HttpClient).dio;
@@ -126,6 +133,7 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
     _downloadSpeeds.clear();
     _uploadSpeeds.clear();
     _latencies.clear();
+    _loadedLatencies.clear();
 
     state = const SpeedTestState();
 
@@ -145,6 +153,7 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
     _downloadSpeeds.clear();
     _uploadSpeeds.clear();
     _latencies.clear();
+    _loadedLatencies.clear();
 
     debugPrint('🛑 Speed test stopped (without state reset)');
   }
@@ -172,6 +181,7 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
     _downloadSpeeds.clear();
     _uploadSpeeds.clear();
     _latencies.clear();
+    _loadedLatencies.clear();
 
     _startConnectionMonitoring();
 
@@ -285,10 +295,18 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
           await _runLatencyMeasurement(measurement);
           break;
         case 'download':
-          await _runDownloadMeasurement(measurement, progress);
+          if (measurement['adaptive'] == true) {
+            await _runAdaptiveDownloadMeasurement();
+          } else {
+            await _runDownloadMeasurement(measurement, progress);
+          }
           break;
         case 'upload':
-          await _runUploadMeasurement(measurement, progress);
+          if (measurement['adaptive'] == true) {
+            await _runAdaptiveUploadMeasurement();
+          } else {
+            await _runUploadMeasurement(measurement, progress);
+          }
           break;
       }
 
@@ -332,7 +350,41 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
       progress: progress,
     );
 
-    final service = DownloadMeasurementService(
+    final service = _createDownloadService();
+    await service.runMeasurement(config);
+    // A warm-up sample is too short to leave slow start; it only gives the
+    // gauge a first reading and is kept out of the result.
+    if (config['bypassMinDuration'] != true) {
+      _downloadSpeeds.addAll(service.downloadSpeeds);
+    }
+  }
+
+  Future<void> _runAdaptiveDownloadMeasurement() async {
+    final scheduler = AdaptiveMeasurementScheduler(
+      budget: SpeedMeasurementConfig.downloadBudget,
+      initialBytes: SpeedMeasurementConfig.initialTransferBytes,
+      maxBytes: SpeedMeasurementConfig.maxDownloadBytes,
+    );
+    final service = _createDownloadService();
+
+    await _runAdaptivePhase(
+      scheduler: scheduler,
+      step: SpeedTestStep.download,
+      label: 'Download test',
+      measure: (config) async {
+        final before = service.downloadSpeeds.length;
+        await service.runMeasurement(config);
+        if (service.downloadSpeeds.length == before) return null;
+        return service.downloadSpeeds.last;
+      },
+      cancelSample: service.cancelSample,
+      lastSampleDuration: () => service.lastSampleDuration,
+    );
+    _downloadSpeeds.addAll(scheduler.resultSamples);
+  }
+
+  DownloadMeasurementService _createDownloadService() {
+    return DownloadMeasurementService(
       api: _api,
       measurementId: _measurementId,
       isCanceledCheck: (reset) => _isTestCanceled,
@@ -352,9 +404,6 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
       },
       latencies: _latencies,
     );
-
-    await service.runMeasurement(config);
-    _downloadSpeeds.addAll(service.downloadSpeeds);
   }
 
   Future<void> _runUploadMeasurement(Map<String, dynamic> config, double progress) async {
@@ -367,7 +416,37 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
       progress: progress,
     );
 
-    final service = UploadMeasurementService(
+    final service = _createUploadService();
+    await service.runMeasurement(config);
+    _uploadSpeeds.addAll(service.uploadSpeeds);
+  }
+
+  Future<void> _runAdaptiveUploadMeasurement() async {
+    final scheduler = AdaptiveMeasurementScheduler(
+      budget: SpeedMeasurementConfig.uploadBudget,
+      initialBytes: SpeedMeasurementConfig.initialTransferBytes,
+      maxBytes: SpeedMeasurementConfig.maxUploadBytes,
+    );
+    final service = _createUploadService();
+
+    await _runAdaptivePhase(
+      scheduler: scheduler,
+      step: SpeedTestStep.upload,
+      label: 'Upload test',
+      measure: (config) async {
+        final before = service.uploadSpeeds.length;
+        await service.runMeasurement(config);
+        if (service.uploadSpeeds.length == before) return null;
+        return service.uploadSpeeds.last;
+      },
+      cancelSample: service.cancelSample,
+      lastSampleDuration: () => service.lastSampleDuration,
+    );
+    _uploadSpeeds.addAll(scheduler.resultSamples);
+  }
+
+  UploadMeasurementService _createUploadService() {
+    return UploadMeasurementService(
       api: _api,
       measurementId: _measurementId,
       isCanceledCheck: (reset) => _isTestCanceled,
@@ -387,9 +466,74 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
       latencies: _latencies,
       measurements: SpeedMeasurementConfig.measurements,
     );
+  }
 
-    await service.runMeasurement(config);
-    _uploadSpeeds.addAll(service.uploadSpeeds);
+  /// Takes one sample at a time at the size and stream count picked by
+  /// [scheduler] until it converges or runs out of time, probing latency in
+  /// the background to measure how much the link queues under load. A sample
+  /// still running when the budget runs out is cancelled and not recorded.
+  Future<void> _runAdaptivePhase({
+    required AdaptiveMeasurementScheduler scheduler,
+    required SpeedTestStep step,
+    required String label,
+    required Future<double?> Function(Map<String, dynamic> config) measure,
+    required void Function() cancelSample,
+    required Duration Function() lastSampleDuration,
+  }) async {
+    int consecutiveFailures = 0;
+    _isProbingLoadedLatency = true;
+    final probe = _probeLoadedLatency();
+
+    try {
+      while (scheduler.hasNext && !_isTestCanceled) {
+        final sizeLabel = SpeedMeasurementConfig.formatBytes(scheduler.bytes);
+        state = state.copyWith(
+          step: step,
+          currentPhase: '$label: $sizeLabel x${scheduler.streams}',
+          progress: scheduler.progress,
+        );
+
+        final deadline = Timer(scheduler.remaining, cancelSample);
+        final speed = await measure({
+          'bytes': scheduler.bytes,
+          'count': 1,
+          'streams': scheduler.streams,
+        });
+        deadline.cancel();
+
+        if (speed == null) {
+          consecutiveFailures++;
+          if (consecutiveFailures >= SpeedMeasurementConfig.maxConsecutiveFailures) {
+            throw Exception('Network connection lost during ${label.toLowerCase()}.');
+          }
+          continue;
+        }
+
+        consecutiveFailures = 0;
+        scheduler.record(speed, lastSampleDuration());
+      }
+    } finally {
+      _isProbingLoadedLatency = false;
+      await probe;
+    }
+
+    debugPrint('   ✅ $label finished after ${scheduler.allSamples.length} samples '
+        '(converged: ${scheduler.converged}, streams: ${scheduler.streams})');
+  }
+
+  Future<void> _probeLoadedLatency() async {
+    while (_isProbingLoadedLatency && !_isTestCanceled) {
+      try {
+        final startTime = DateTime.now();
+        await _api.latencyTest(measurementId: _measurementId);
+        if (_isProbingLoadedLatency) {
+          _loadedLatencies.add(DateTime.now().difference(startTime).inMilliseconds);
+        }
+      } catch (e) {
+        debugPrint('   ⚠️ Loaded latency probe failed: $e');
+      }
+      await Future.delayed(SpeedMeasurementConfig.loadedLatencyInterval);
+    }
   }
 
   void _calculateFinalResults() {
@@ -398,6 +542,7 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
       uploadSpeeds: _uploadSpeeds,
       latencies: _latencies,
       measurements: SpeedMeasurementConfig.measurements,
+      loadedLatencies: _loadedLatencies,
     );
 
     state = state.copyWith(
@@ -411,6 +556,53 @@ class SpeedTestNotifier extends StateNotifier<SpeedTestState> {
       measurementId: _measurementId,
       result: result,
     );
+    _recordHistory(result);
+  }
+
+  void _recordHistory(SpeedTestResult result) {
+    if (!Platform.isLinux) return;
+
+    final method = _ref.read(groupStateProvider).groupName;
+    VpnBridge()
+        .recordHistory({
+          "download": result.downloadSpeed,
+          "upload": result.uploadSpeed,
+          "ping": result.ping,
+          "jitter": result.jitter,
+          "packetLoss": result.packetLoss,
+          "method": method,
+        })
+        .then((_) => _logHistorySummary(method))
+        .catchError((e) => debugPrint('⚠️ Failed to record speed test history: $e'));
+  }
+
+  // Puts the result in context of the last four weeks on the same method in
+  // the app log, which users share with support. A test run without a method,
+  // such as one while disconnected, is compared with every method.
+  Future<void> _logHistorySummary(String method) async {
+    final now = DateTime.now();
+    final summary = await VpnBridge().getHistorySummary(
+      now.subtract(const Duration(days: 28)),
+      now,
+      method: method,
+    );
+
+    String median(String column, String unit) {
+      final values = summary[column] as Map?;
+      if (values == null || values["count"] == 0) return "-";
+      final p50 = (values["p50"] as num).toStringAsFixed(1);
+      final p90 = (values["p90"] as num).toStringAsFixed(1);
+      return "$p50 $unit (p90 $p90)";
+    }
+
+    // Connection attempts are recorded too but carry no download speed.
+    final runs = (summary["download"] as Map?)?["count"] ?? 0;
+    final scope = method.isEmpty ? "all methods" : method;
+    Log().addLog("[INFO] Speed tests on $scope "
+        "over 28 days: $runs runs, "
+        "download ${median("download", "Mbps")}, "
+        "upload ${median("upload", "Mbps")}, "
+        "ping ${median("ping", "ms")}");
   }
 
   void _checkConnectionStability() {
@@ -15,6 +15,7 @@ abstract class SpeedTestApi {
     @Query('bytes') required int bytes,
     @Query('measId') required String measurementId,
     @Query('during') String? during,
+    @CancelRequest() CancelToken? cancelToken,
     @SendProgress() ProgressCallback? onSendProgress,
     @ReceiveProgress() ProgressCallback? onReceiveProgress,
   });
@@ -27,6 +28,7 @@ abstract class SpeedTestApi {
     @Header('Content-Length') required int contentLength,
     @Query('measId') required String measurementId,
     @Query('during') String? during,
+    @CancelRequest() CancelToken? cancelToken,
     @SendProgress() ProgressCallback? onSendProgress,
     @ReceiveProgress() ProgressCallback? onReceiveProgress,
   });
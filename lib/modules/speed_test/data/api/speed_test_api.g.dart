@@ -24,6 +24,7 @@ class _SpeedTestApi implements SpeedTestApi {
     required int bytes,
     required String measurementId,
     String? during,
+    CancelToken? cancelToken,
     void Function(int, int)? onSendProgress,
     void Function(int, int)? onReceiveProgress,
   }) async {
@@ -48,6 +49,7 @@ class _SpeedTestApi implements SpeedTestApi {
             '/__down',
             queryParameters: queryParameters,
             data: _data,
+            cancelToken: cancelToken,
             onSendProgress: onSendProgress,
             onReceiveProgress: onReceiveProgress,
           )
@@ -72,6 +74,7 @@ class _SpeedTestApi implements SpeedTestApi {
     required int contentLength,
     required String measurementId,
     String? during,
+    CancelToken? cancelToken,
     void Function(int, int)? onSendProgress,
     void Function(int, int)? onReceiveProgress,
   }) async {
@@ -99,6 +102,7 @@ class _SpeedTestApi implements SpeedTestApi {
             '/__up',
             queryParameters: queryParameters,
             data: _data,
+            cancelToken: cancelToken,
             onSendProgress: onSendProgress,
             onReceiveProgress: onReceiveProgress,
           )
@@ -13,6 +13,9 @@ class SpeedTestResult {
   final double packetLoss;
   final int jitter;
 
+  /// Median latency while the link is saturated by a throughput phase.
+  final int loadedLatency;
+
   const SpeedTestResult({
     this.downloadSpeed = 0.0,
     this.uploadSpeed = 0.0,
@@ -20,8 +23,13 @@ class SpeedTestResult {
     this.latency = 0,
     this.packetLoss = 0.0,
     this.jitter = 0,
+    this.loadedLatency = 0,
   });
 
+  /// Latency added by queueing under load (loaded minus idle latency).
+  int get bufferbloat =>
+      loadedLatency > latency ? loadedLatency - latency : 0;
+
   SpeedTestResult copyWith({
     double? downloadSpeed,
     double? uploadSpeed,
@@ -29,6 +37,7 @@ class SpeedTestResult {
     int? latency,
     double? packetLoss,
     int? jitter,
+    int? loadedLatency,
   }) {
     return SpeedTestResult(
       downloadSpeed: downloadSpeed ?? this.downloadSpeed,
@@ -37,6 +46,7 @@ class SpeedTestResult {
       latency: latency ?? this.latency,
       packetLoss: packetLoss ?? this.packetLoss,
       jitter: jitter ?? this.jitter,
+      loadedLatency: loadedLatency ?? this.loadedLatency,
     );
   }
 }
@@ -6,7 +6,9 @@ class FirebaseAnalyticsService {
   static final FirebaseAnalyticsService _instance = FirebaseAnalyticsService._internal();
   factory FirebaseAnalyticsService() => _instance;
 
-  final FirebaseAnalytics _analytics = FirebaseAnalytics.instance;
+  // Resolved on first use: Firebase is not initialised on Linux, where the
+  // lookup throws and each event below is dropped instead.
+  late final FirebaseAnalytics _analytics = FirebaseAnalytics.instance;
 
   FirebaseAnalyticsObserver getAnalyticsObserver() =>
       FirebaseAnalyticsObserver(analytics: _analytics);
@@ -0,0 +1,291 @@
+#include "control_socket.h"
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+
+namespace {
+
+constexpr uint8_t kProtocolVersion = 1;
+constexpr size_t kHeaderSize = 4;
+
+// Requests carry no payload today; anything larger than this is not a
+// client speaking this protocol.
+constexpr size_t kMaxRequestPayload = 1024;
+
+constexpr size_t kMaxClients = 16;
+constexpr size_t kReceiveBufferSize = 4096;
+
+bool FillAddress(const std::string& path, sockaddr_un* address) {
+  if (path.size() >= sizeof(address->sun_path)) {
+    return false;
+  }
+  memset(address, 0, sizeof(*address));
+  address->sun_family = AF_UNIX;
+  memcpy(address->sun_path, path.c_str(), path.size() + 1);
+  return true;
+}
+
+}  // namespace
+
+ControlSocket::ControlSocket(std::string path, RequestHandler handler)
+    : path_(std::move(path)),
+      handler_(std::move(handler)),
+      self_(std::make_shared<ControlSocket*>(this)) {}
+
+ControlSocket::~ControlSocket() { Stop(); }
+
+bool ControlSocket::Start() {
+  if (fd_ >= 0) {
+    return true;
+  }
+
+  sockaddr_un address;
+  if (!FillAddress(path_, &address)) {
+    g_warning("Control socket path is too long: %s", path_.c_str());
+    return false;
+  }
+
+  g_autofree gchar* directory = g_path_get_dirname(path_.c_str());
+  if (g_mkdir_with_parents(directory, 0700) != 0) {
+    g_warning("Failed to create %s: %s", directory, strerror(errno));
+    return false;
+  }
+
+  if (IsAnotherDaemonListening()) {
+    g_warning("Another daemon is already listening on %s", path_.c_str());
+    return false;
+  }
+  unlink(path_.c_str());
+
+  fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) {
+    g_warning("Failed to open control socket: %s", strerror(errno));
+    return false;
+  }
+
+  // Keep other users out from the moment the socket exists.
+  mode_t mask = umask(0077);
+  int bound =
+      bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+  umask(mask);
+  if (bound != 0 || listen(fd_, SOMAXCONN) != 0) {
+    g_warning("Failed to listen on %s: %s", path_.c_str(), strerror(errno));
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+
+  watch_id_ = g_unix_fd_add(fd_, G_IO_IN, OnListenReadable, this);
+  return true;
+}
+
+void ControlSocket::Stop() {
+  while (!clients_.empty()) {
+    CloseClient(clients_.begin()->first);
+  }
+  if (watch_id_ != 0) {
+    g_source_remove(watch_id_);
+    watch_id_ = 0;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+    unlink(path_.c_str());
+  }
+}
+
+// static
+gboolean ControlSocket::OnListenReadable(gint fd, GIOCondition condition,
+                                         gpointer user_data) {
+  static_cast<ControlSocket*>(user_data)->Accept();
+  return G_SOURCE_CONTINUE;
+}
+
+// static
+gboolean ControlSocket::OnClientReadable(gint fd, GIOCondition condition,
+                                         gpointer user_data) {
+  Watch* watch = static_cast<Watch*>(user_data);
+  ControlSocket* self = watch->socket;
+  int id = watch->client;
+
+  if (!self->Receive(id)) {
+    // Also destroys |watch|.
+    self->CloseClient(id);
+    return G_SOURCE_REMOVE;
+  }
+
+  // Clients may shut down their side right after writing a request; answer
+  // what they sent before closing.
+  Client& client = self->clients_[id];
+  bool eof = client.eof;
+  if (eof) {
+    client.watch_id = 0;
+  }
+  self->ProcessNext(id);
+  return eof ? G_SOURCE_REMOVE : G_SOURCE_CONTINUE;
+}
+
+bool ControlSocket::IsAnotherDaemonListening() const {
+  sockaddr_un address;
+  FillAddress(path_, &address);
+  int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (probe < 0) {
+    return false;
+  }
+  bool listening = connect(probe, reinterpret_cast<sockaddr*>(&address),
+                           sizeof(address)) == 0;
+  close(probe);
+  return listening;
+}
+
+void ControlSocket::Accept() {
+  for (;;) {
+    int fd = accept4(fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        g_warning("Failed to accept control client: %s", strerror(errno));
+      }
+      return;
+    }
+
+    // The socket's permissions already keep other users out; this also
+    // covers a socket path placed in a shared directory.
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0 ||
+        credentials.uid != getuid() || clients_.size() >= kMaxClients) {
+      close(fd);
+      continue;
+    }
+
+    int id = next_client_++;
+    Client& client = clients_[id];
+    client.fd = fd;
+    client.watch_id = g_unix_fd_add_full(
+        G_PRIORITY_DEFAULT, fd,
+        static_cast<GIOCondition>(G_IO_IN | G_IO_ERR | G_IO_HUP),
+        OnClientReadable, new Watch{this, id},
+        [](gpointer data) { delete static_cast<Watch*>(data); });
+  }
+}
+
+bool ControlSocket::Receive(int id) {
+  Client& client = clients_[id];
+  char buffer[kReceiveBufferSize];
+  for (;;) {
+    ssize_t length = recv(client.fd, buffer, sizeof(buffer), 0);
+    if (length > 0) {
+      client.input.append(buffer, length);
+      if (client.input.size() > kHeaderSize + kMaxRequestPayload) {
+        return false;
+      }
+      continue;
+    }
+    if (length == 0) {
+      client.eof = true;
+      return true;
+    }
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  }
+}
+
+void ControlSocket::ProcessNext(int id) {
+  auto it = clients_.find(id);
+  if (it == clients_.end()) {
+    return;
+  }
+  Client& client = it->second;
+  if (client.busy) {
+    return;
+  }
+  if (client.input.size() < kHeaderSize) {
+    if (client.eof) {
+      CloseClient(id);
+    }
+    return;
+  }
+
+  const uint8_t* header = reinterpret_cast<const uint8_t*>(client.input.data());
+  uint8_t version = header[0];
+  uint8_t command = header[1];
+  size_t payload_length = header[2] | (header[3] << 8);
+  if (version != kProtocolVersion || payload_length > kMaxRequestPayload) {
+    Send(id, kBadRequest, "Unsupported request");
+    CloseClient(id);
+    return;
+  }
+  if (client.input.size() < kHeaderSize + payload_length) {
+    if (client.eof) {
+      CloseClient(id);
+    }
+    return;
+  }
+  client.input.erase(0, kHeaderSize + payload_length);
+
+  if (command < kConnect || command > kPing) {
+    Send(id, kUnknownCommand, "Unknown command");
+    ProcessNext(id);
+    return;
+  }
+
+  client.busy = true;
+  std::weak_ptr<ControlSocket*> weak_self = self_;
+  handler_(static_cast<Command>(command),
+           [weak_self, id](Status status, const std::string& payload) {
+             std::shared_ptr<ControlSocket*> self = weak_self.lock();
+             if (!self) {
+               return;
+             }
+             ControlSocket* socket = *self;
+             auto client = socket->clients_.find(id);
+             if (client == socket->clients_.end() || !client->second.busy) {
+               return;
+             }
+             client->second.busy = false;
+             socket->Send(id, status, payload);
+             socket->ProcessNext(id);
+           });
+}
+
+void ControlSocket::Send(int id, uint8_t code, const std::string& payload) {
+  auto it = clients_.find(id);
+  if (it == clients_.end()) {
+    return;
+  }
+
+  size_t length = std::min<size_t>(payload.size(), UINT16_MAX);
+  std::string frame;
+  frame.reserve(kHeaderSize + length);
+  frame.push_back(static_cast<char>(kProtocolVersion));
+  frame.push_back(static_cast<char>(code));
+  frame.push_back(static_cast<char>(length & 0xff));
+  frame.push_back(static_cast<char>(length >> 8));
+  frame.append(payload, 0, length);
+
+  // Responses are a few bytes; a client that cannot take them at once is
+  // not reading and is dropped.
+  ssize_t sent = send(it->second.fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+  if (sent != static_cast<ssize_t>(frame.size())) {
+    CloseClient(id);
+  }
+}
+
+void ControlSocket::CloseClient(int id) {
+  auto it = clients_.find(id);
+  if (it == clients_.end()) {
+    return;
+  }
+  if (it->second.watch_id != 0) {
+    g_source_remove(it->second.watch_id);
+  }
+  close(it->second.fd);
+  clients_.erase(it);
+}
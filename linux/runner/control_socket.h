@@ -0,0 +1,111 @@
+#ifndef RUNNER_CONTROL_SOCKET_H_
+#define RUNNER_CONTROL_SOCKET_H_
+
+#include <glib.h>
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+// Serves the headless daemon's control protocol on a Unix-domain stream
+// socket that only the user running the daemon may connect to.
+//
+// Both directions use frames of a four byte header followed by a payload:
+//
+//   u8 version (1) | u8 code | u16 payload length, little endian | payload
+//
+// In requests the code is a Command and the payload is empty. In responses
+// the code is a Status; on success the payload is
+//
+//   connect, disconnect, status: u8 state, see below
+//   ping:                        u32 round trip in ms, little endian
+//
+// and otherwise a UTF-8 error message. The state is one of 0 disconnected,
+// 1 connecting, 2 connected, 3 disconnecting, 4 failed, 5 no internet.
+// Requests on one connection are answered one at a time, in order.
+//
+// Only status and disconnect work for now. The Linux runner cannot start a
+// tunnel, so connect and ping always fail with kFailed and an UNSUPPORTED
+// message, and status stays at 0 disconnected.
+//
+// Runs on the main context it was started from.
+class ControlSocket {
+ public:
+  enum Command : uint8_t {
+    kConnect = 1,
+    kDisconnect = 2,
+    kStatus = 3,
+    kPing = 4,
+  };
+
+  enum Status : uint8_t {
+    kOk = 0,
+    kFailed = 1,
+    kUnknownCommand = 2,
+    kBadRequest = 3,
+  };
+
+  using Reply = std::function<void(Status status, const std::string& payload)>;
+
+  // Handles one request. |reply| may be called later, at most once; it does
+  // nothing if the client or the socket has gone away in the meantime.
+  using RequestHandler = std::function<void(Command command, Reply reply)>;
+
+  ControlSocket(std::string path, RequestHandler handler);
+  ~ControlSocket();
+
+  ControlSocket(const ControlSocket&) = delete;
+  ControlSocket& operator=(const ControlSocket&) = delete;
+
+  // Creates the socket at the path, replacing a stale one. Returns false if
+  // it cannot be created or another daemon is already listening on it.
+  bool Start();
+
+  // Disconnects all clients and removes the socket.
+  void Stop();
+
+ private:
+  struct Client {
+    int fd = -1;
+    guint watch_id = 0;
+    std::string input;
+    bool busy = false;
+    // The client has shut down its side; close once it has been answered.
+    bool eof = false;
+  };
+
+  // Handed to the watches, which outlive neither the client nor the socket.
+  struct Watch {
+    ControlSocket* socket;
+    int client;
+  };
+
+  static gboolean OnListenReadable(gint fd, GIOCondition condition,
+                                   gpointer user_data);
+  static gboolean OnClientReadable(gint fd, GIOCondition condition,
+                                   gpointer user_data);
+
+  bool IsAnotherDaemonListening() const;
+  void Accept();
+  // Reads what is available; returns false on errors and oversized input.
+  bool Receive(int id);
+  // Starts on the next complete request, unless one is being handled.
+  void ProcessNext(int id);
+  void Send(int id, uint8_t code, const std::string& payload);
+  void CloseClient(int id);
+
+  const std::string path_;
+  RequestHandler handler_;
+  int fd_ = -1;
+  guint watch_id_ = 0;
+  int next_client_ = 0;
+  std::map<int, Client> clients_;
+
+  // Replies hold a weak reference so that they can tell whether the socket
+  // still exists when the answer arrives.
+  std::shared_ptr<ControlSocket*> self_;
+};
+
+#endif  // RUNNER_CONTROL_SOCKET_H_
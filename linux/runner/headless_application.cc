@@ -0,0 +1,132 @@
+#include "headless_application.h"
+
+#include <flutter_linux/flutter_linux.h>
+#include <glib-unix.h>
+#include <gtk/gtk.h>
+#include <signal.h>
+
+#include "flutter/generated_plugin_registrant.h"
+#include "vpn_channel.h"
+
+struct _HeadlessApplication {
+  GApplication parent_instance;
+  FlEngine* engine;
+  VpnChannel* vpn_channel;
+  guint sigterm_id;
+  guint sigint_id;
+};
+
+G_DEFINE_TYPE(HeadlessApplication, headless_application, G_TYPE_APPLICATION)
+
+// Quits the main loop so the VPN channel is disposed, and with it any secrets
+// still waiting to be written back, before the process exits.
+static gboolean headless_application_quit_cb(gpointer user_data) {
+  g_application_quit(G_APPLICATION(user_data));
+  return G_SOURCE_CONTINUE;
+}
+
+// Defaults to $XDG_RUNTIME_DIR/defyx_vpn/control.sock; can be overridden with
+// DEFYX_CONTROL_SOCKET.
+static gchar* headless_application_get_socket_path() {
+  const gchar* path = g_getenv("DEFYX_CONTROL_SOCKET");
+  if (path != nullptr && path[0] != '\0') {
+    return g_strdup(path);
+  }
+  return g_build_filename(g_get_user_runtime_dir(), "defyx_vpn",
+                          "control.sock", nullptr);
+}
+
+static gboolean headless_application_start(HeadlessApplication* self,
+                                           gchar** dart_entrypoint_arguments) {
+  g_autoptr(FlDartProject) project = fl_dart_project_new();
+  fl_dart_project_set_dart_entrypoint_arguments(project,
+                                                dart_entrypoint_arguments);
+
+  self->engine = fl_engine_new_headless(project);
+  fl_register_plugins(FL_PLUGIN_REGISTRY(self->engine));
+
+  // Register the channels before Dart starts sending on them.
+  FlBinaryMessenger* messenger = fl_engine_get_binary_messenger(self->engine);
+  self->vpn_channel = vpn_channel_new(messenger);
+  g_autofree gchar* socket_path = headless_application_get_socket_path();
+  if (!vpn_channel_start_control_socket(self->vpn_channel, messenger,
+                                        socket_path)) {
+    return FALSE;
+  }
+
+  g_autoptr(GError) error = nullptr;
+  if (!fl_engine_start(self->engine, &error)) {
+    g_warning("Failed to start Flutter engine: %s", error->message);
+    return FALSE;
+  }
+
+  g_message(
+      "Listening for control commands on %s; only status and disconnect "
+      "work, as this build cannot start a tunnel",
+      socket_path);
+  return TRUE;
+}
+
+// Implements GApplication::command_line.
+static int headless_application_command_line(
+    GApplication* application, GApplicationCommandLine* command_line) {
+  HeadlessApplication* self = HEADLESS_APPLICATION(application);
+
+  // A launch of the app while the daemon owns the application ID ends up
+  // here; there is no window to show it.
+  if (g_application_command_line_get_is_remote(command_line)) {
+    g_application_command_line_printerr(
+        command_line, "defyx_vpn is running headless; use its control socket\n");
+    return 1;
+  }
+
+  g_auto(GStrv) arguments =
+      g_application_command_line_get_arguments(command_line, nullptr);
+  // Strip out the first argument as it is the binary name.
+  if (!headless_application_start(self, arguments + 1)) {
+    return 1;
+  }
+
+  g_application_hold(application);
+  self->sigterm_id =
+      g_unix_signal_add(SIGTERM, headless_application_quit_cb, application);
+  self->sigint_id =
+      g_unix_signal_add(SIGINT, headless_application_quit_cb, application);
+  return 0;
+}
+
+// Implements GApplication::startup.
+static void headless_application_startup(GApplication* application) {
+  // Plugins may create GTK objects; this succeeds without a display too.
+  gtk_init_check(nullptr, nullptr);
+
+  G_APPLICATION_CLASS(headless_application_parent_class)->startup(application);
+}
+
+// Implements GObject::dispose.
+static void headless_application_dispose(GObject* object) {
+  HeadlessApplication* self = HEADLESS_APPLICATION(object);
+  g_clear_handle_id(&self->sigterm_id, g_source_remove);
+  g_clear_handle_id(&self->sigint_id, g_source_remove);
+  g_clear_object(&self->vpn_channel);
+  g_clear_object(&self->engine);
+  G_OBJECT_CLASS(headless_application_parent_class)->dispose(object);
+}
+
+static void headless_application_class_init(HeadlessApplicationClass* klass) {
+  G_APPLICATION_CLASS(klass)->command_line = headless_application_command_line;
+  G_APPLICATION_CLASS(klass)->startup = headless_application_startup;
+  G_OBJECT_CLASS(klass)->dispose = headless_application_dispose;
+}
+
+static void headless_application_init(HeadlessApplication* self) {}
+
+HeadlessApplication* headless_application_new() {
+  g_set_prgname(APPLICATION_ID);
+
+  // Shares the GUI's application ID so the two never run side by side.
+  return HEADLESS_APPLICATION(
+      g_object_new(headless_application_get_type(), "application-id",
+                   APPLICATION_ID, "flags", G_APPLICATION_HANDLES_COMMAND_LINE,
+                   nullptr));
+}
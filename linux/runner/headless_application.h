@@ -0,0 +1,23 @@
+#ifndef RUNNER_HEADLESS_APPLICATION_H_
+#define RUNNER_HEADLESS_APPLICATION_H_
+
+#include <gio/gio.h>
+
+G_DECLARE_FINAL_TYPE(HeadlessApplication, headless_application, HEADLESS,
+                     APPLICATION, GApplication)
+
+/**
+ * headless_application_new:
+ *
+ * Creates the application used for --headless runs: the Flutter engine runs
+ * without a window and is driven over a Unix-domain control socket instead.
+ * This is a plain #GApplication as #GtkApplication needs a display.
+ *
+ * The runner cannot start a tunnel yet, so of the socket's commands only
+ * status and disconnect work; see control_socket.h.
+ *
+ * Returns: a new #HeadlessApplication.
+ */
+HeadlessApplication* headless_application_new();
+
+#endif  // RUNNER_HEADLESS_APPLICATION_H_
@@ -0,0 +1,399 @@
+#include "history_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <glib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <utility>
+
+namespace {
+
+constexpr char kMagic[8] = {'D', 'F', 'X', 'H', 'I', 'S', 'T', '1'};
+constexpr uint32_t kVersion = 1;
+
+// Column files grow by this many rows at a time; a row is 36 bytes, so each
+// step is roughly 150 KB across all columns.
+constexpr uint64_t kGrowRows = 4096;
+
+constexpr char kMethodsFile[] = "methods.txt";
+
+const char* const kColumnFiles[] = {
+    "timestamp.i64", "download.f32", "upload.f32", "ping.f32",
+    "jitter.f32",    "loss.f32",     "connect.f32", "method.u32",
+};
+
+constexpr size_t kColumnWidths[] = {
+    sizeof(int64_t), sizeof(float), sizeof(float), sizeof(float),
+    sizeof(float),   sizeof(float), sizeof(float), sizeof(uint32_t),
+};
+
+// Index of |percentile| in |count| sorted values.
+size_t PercentileIndex(size_t count, double percentile) {
+  size_t index = static_cast<size_t>(
+      std::lround(percentile * static_cast<double>(count - 1)));
+  return std::min(index, count - 1);
+}
+
+}  // namespace
+
+struct HistoryStore::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t rows;
+};
+
+HistoryStore::HistoryStore(std::string directory)
+    : directory_(std::move(directory)) {}
+
+HistoryStore::~HistoryStore() { Close(); }
+
+bool HistoryStore::Open() {
+  if (header_file_.data != nullptr) {
+    return true;
+  }
+
+  if (g_mkdir_with_parents(directory_.c_str(), 0700) != 0) {
+    g_warning("Failed to create history directory %s: %s", directory_.c_str(),
+              strerror(errno));
+    return false;
+  }
+
+  if (!MapFile("header", sizeof(Header), &header_file_)) {
+    return false;
+  }
+
+  Header* header = static_cast<Header*>(header_file_.data);
+  if (header->version == 0) {
+    memcpy(header->magic, kMagic, sizeof(kMagic));
+    header->version = kVersion;
+    header->rows = 0;
+  } else if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+             header->version != kVersion) {
+    g_warning("Unrecognised history store in %s", directory_.c_str());
+    Close();
+    return false;
+  }
+
+  capacity_ = (header->rows / kGrowRows + 1) * kGrowRows;
+  for (int column = 0; column < kColumnCount; column++) {
+    if (!MapFile(kColumnFiles[column], capacity_ * kColumnWidths[column],
+                 &columns_[column])) {
+      Close();
+      return false;
+    }
+  }
+
+  if (!LoadMethods()) {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void HistoryStore::Close() {
+  for (MappedFile& column : columns_) {
+    UnmapFile(&column);
+  }
+  UnmapFile(&header_file_);
+  capacity_ = 0;
+  methods_.clear();
+}
+
+bool HistoryStore::Append(const HistoryRecord& record) {
+  if (header_file_.data == nullptr) {
+    return false;
+  }
+
+  Header* header = static_cast<Header*>(header_file_.data);
+  uint64_t row = header->rows;
+  if (!Reserve(row + 1)) {
+    return false;
+  }
+
+  // Keep the timestamp column sorted even if the wall clock steps back.
+  int64_t timestamp_ms = record.timestamp_ms;
+  if (row > 0) {
+    timestamp_ms = std::max(timestamp_ms, timestamps()[row - 1]);
+  }
+
+  static_cast<int64_t*>(columns_[kTimestamp].data)[row] = timestamp_ms;
+  static_cast<float*>(columns_[kDownload].data)[row] = record.download_mbps;
+  static_cast<float*>(columns_[kUpload].data)[row] = record.upload_mbps;
+  static_cast<float*>(columns_[kPing].data)[row] = record.ping_ms;
+  static_cast<float*>(columns_[kJitter].data)[row] = record.jitter_ms;
+  static_cast<float*>(columns_[kPacketLoss].data)[row] = record.packet_loss;
+  static_cast<float*>(columns_[kConnect].data)[row] = record.connect_ms;
+  static_cast<uint32_t*>(columns_[kMethod].data)[row] = MethodId(record.method);
+
+  // Publish the row only once every column holds it.
+  __atomic_store_n(&header->rows, row + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+HistorySummary HistoryStore::Summarize(int64_t from_ms, int64_t to_ms,
+                                       const std::string& method) const {
+  HistorySummary summary;
+  if (header_file_.data == nullptr || to_ms <= from_ms) {
+    return summary;
+  }
+
+  int64_t method_id = -1;
+  if (!method.empty()) {
+    auto it = std::find(methods_.begin(), methods_.end(), method);
+    // An unknown method matches nothing. Its id cannot stand in for that,
+    // since id 0 is what rows recorded without a method carry.
+    if (it == methods_.end()) {
+      return summary;
+    }
+    method_id = (it - methods_.begin()) + 1;
+  }
+
+  size_t begin = LowerBound(from_ms);
+  size_t end = LowerBound(to_ms);
+  if (method_id < 0) {
+    summary.rows = end - begin;
+  } else {
+    const uint32_t* ids = method_ids();
+    for (size_t row = begin; row < end; row++) {
+      summary.rows += ids[row] == static_cast<uint32_t>(method_id);
+    }
+  }
+
+  summary.download_mbps = SummarizeColumn(kDownload, begin, end, method_id);
+  summary.upload_mbps = SummarizeColumn(kUpload, begin, end, method_id);
+  summary.ping_ms = SummarizeColumn(kPing, begin, end, method_id);
+  summary.jitter_ms = SummarizeColumn(kJitter, begin, end, method_id);
+  summary.packet_loss = SummarizeColumn(kPacketLoss, begin, end, method_id);
+  summary.connect_ms = SummarizeColumn(kConnect, begin, end, method_id);
+  return summary;
+}
+
+uint64_t HistoryStore::rows() const {
+  if (header_file_.data == nullptr) {
+    return 0;
+  }
+  const Header* header = static_cast<const Header*>(header_file_.data);
+  return __atomic_load_n(&header->rows, __ATOMIC_ACQUIRE);
+}
+
+bool HistoryStore::MapFile(const std::string& name, size_t size,
+                           MappedFile* file) {
+  std::string path = directory_ + "/" + name;
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  if (fd < 0) {
+    g_warning("Failed to open %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  struct stat status;
+  if (fstat(fd, &status) != 0) {
+    close(fd);
+    return false;
+  }
+  size = std::max(size, static_cast<size_t>(status.st_size));
+  if (static_cast<size_t>(status.st_size) < size && ftruncate(fd, size) != 0) {
+    g_warning("Failed to size %s: %s", path.c_str(), strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    g_warning("Failed to map %s: %s", path.c_str(), strerror(errno));
+    close(fd);
+    return false;
+  }
+
+  file->fd = fd;
+  file->data = data;
+  file->size = size;
+  return true;
+}
+
+bool HistoryStore::GrowFile(MappedFile* file, size_t size) {
+  if (size <= file->size) {
+    return true;
+  }
+  if (ftruncate(file->fd, size) != 0) {
+    g_warning("Failed to grow history column: %s", strerror(errno));
+    return false;
+  }
+  void* data = mremap(file->data, file->size, size, MREMAP_MAYMOVE);
+  if (data == MAP_FAILED) {
+    g_warning("Failed to remap history column: %s", strerror(errno));
+    return false;
+  }
+  file->data = data;
+  file->size = size;
+  return true;
+}
+
+void HistoryStore::UnmapFile(MappedFile* file) {
+  if (file->data != nullptr) {
+    munmap(file->data, file->size);
+    file->data = nullptr;
+  }
+  if (file->fd >= 0) {
+    close(file->fd);
+    file->fd = -1;
+  }
+  file->size = 0;
+}
+
+bool HistoryStore::Reserve(uint64_t rows) {
+  if (rows <= capacity_) {
+    return true;
+  }
+  uint64_t capacity = (rows / kGrowRows + 1) * kGrowRows;
+  for (int column = 0; column < kColumnCount; column++) {
+    if (!GrowFile(&columns_[column], capacity * kColumnWidths[column])) {
+      return false;
+    }
+  }
+  capacity_ = capacity;
+  return true;
+}
+
+bool HistoryStore::LoadMethods() {
+  methods_.clear();
+  std::ifstream file(directory_ + "/" + kMethodsFile);
+  std::string line;
+  while (std::getline(file, line)) {
+    methods_.push_back(line);
+  }
+  return true;
+}
+
+uint32_t HistoryStore::MethodId(const std::string& method) {
+  if (method.empty()) {
+    return 0;
+  }
+  auto it = std::find(methods_.begin(), methods_.end(), method);
+  if (it != methods_.end()) {
+    return static_cast<uint32_t>(it - methods_.begin()) + 1;
+  }
+
+  std::string label = method;
+  std::replace(label.begin(), label.end(), '\n', ' ');
+  std::ofstream file(directory_ + "/" + kMethodsFile, std::ios::app);
+  file << label << '\n';
+  if (!file) {
+    g_warning("Failed to record connection method %s", label.c_str());
+    return 0;
+  }
+  methods_.push_back(label);
+  return static_cast<uint32_t>(methods_.size());
+}
+
+const int64_t* HistoryStore::timestamps() const {
+  return static_cast<const int64_t*>(columns_[kTimestamp].data);
+}
+
+const float* HistoryStore::values(Column column) const {
+  return static_cast<const float*>(columns_[column].data);
+}
+
+const uint32_t* HistoryStore::method_ids() const {
+  return static_cast<const uint32_t*>(columns_[kMethod].data);
+}
+
+size_t HistoryStore::LowerBound(int64_t timestamp_ms) const {
+  const int64_t* begin = timestamps();
+  const int64_t* end = begin + rows();
+  return std::lower_bound(begin, end, timestamp_ms) - begin;
+}
+
+ColumnSummary HistoryStore::SummarizeColumn(Column column, size_t begin,
+                                            size_t end,
+                                            int64_t method_id) const {
+  ColumnSummary summary;
+  if (begin >= end) {
+    return summary;
+  }
+
+  const float* data = values(column);
+  const uint32_t* ids = method_ids();
+
+  // Gather the values that count into a contiguous buffer without branching:
+  // every value is written, and the write position only moves past those
+  // that are present and recorded with |method_id|. Missing values are
+  // stored as NaN, which compares unequal to itself.
+  std::vector<float> valid(end - begin);
+  size_t count = 0;
+  if (method_id < 0) {
+    for (size_t row = begin; row < end; row++) {
+      float value = data[row];
+      valid[count] = value;
+      count += value == value;
+    }
+  } else {
+    uint32_t id = static_cast<uint32_t>(method_id);
+    for (size_t row = begin; row < end; row++) {
+      float value = data[row];
+      valid[count] = value;
+      count += (value == value) & (ids[row] == id);
+    }
+  }
+  valid.resize(count);
+
+  summary.count = count;
+  if (count == 0) {
+    return summary;
+  }
+
+  // Min, max and sum in one branch-free pass over the gathered values, kept
+  // in independent lanes so consecutive values do not wait on each other.
+  constexpr size_t kLanes = 4;
+  float low[kLanes];
+  float high[kLanes];
+  double sum[kLanes] = {};
+  std::fill(low, low + kLanes, valid[0]);
+  std::fill(high, high + kLanes, valid[0]);
+  size_t index = 0;
+  for (; index + kLanes <= count; index += kLanes) {
+    for (size_t lane = 0; lane < kLanes; lane++) {
+      float value = valid[index + lane];
+      low[lane] = std::min(low[lane], value);
+      high[lane] = std::max(high[lane], value);
+      sum[lane] += value;
+    }
+  }
+  for (; index < count; index++) {
+    low[0] = std::min(low[0], valid[index]);
+    high[0] = std::max(high[0], valid[index]);
+    sum[0] += valid[index];
+  }
+  for (size_t lane = 1; lane < kLanes; lane++) {
+    low[0] = std::min(low[0], low[lane]);
+    high[0] = std::max(high[0], high[lane]);
+    sum[0] += sum[lane];
+  }
+
+  summary.min = low[0];
+  summary.max = high[0];
+  summary.mean = static_cast<float>(sum[0] / static_cast<double>(count));
+
+  // Select the percentiles in increasing order instead of sorting the whole
+  // window. Each selection leaves the values above it in the upper range,
+  // so the next one only searches there; it may reorder the value just
+  // selected, which is why each is read right away.
+  auto first = valid.begin();
+  size_t p50 = PercentileIndex(valid.size(), 0.5);
+  size_t p90 = PercentileIndex(valid.size(), 0.9);
+  size_t p99 = PercentileIndex(valid.size(), 0.99);
+  std::nth_element(first, first + p50, valid.end());
+  summary.p50 = valid[p50];
+  std::nth_element(first + p50, first + p90, valid.end());
+  summary.p90 = valid[p90];
+  std::nth_element(first + p90, first + p99, valid.end());
+  summary.p99 = valid[p99];
+  return summary;
+}
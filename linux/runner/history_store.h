@@ -0,0 +1,120 @@
+#ifndef RUNNER_HISTORY_STORE_H_
+#define RUNNER_HISTORY_STORE_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+// One row of the history. Speed tests fill the throughput and latency fields;
+// connection attempts fill |connect_ms| on success and leave it NaN on
+// failure. Fields that do not apply are NaN.
+struct HistoryRecord {
+  int64_t timestamp_ms = 0;
+  float download_mbps = NAN;
+  float upload_mbps = NAN;
+  float ping_ms = NAN;
+  float jitter_ms = NAN;
+  float packet_loss = NAN;
+  float connect_ms = NAN;
+  std::string method;
+};
+
+// Aggregates of one column over a time window. NaN values are skipped; all
+// fields are NaN when |count| is zero.
+struct ColumnSummary {
+  uint64_t count = 0;
+  float min = NAN;
+  float max = NAN;
+  float mean = NAN;
+  float p50 = NAN;
+  float p90 = NAN;
+  float p99 = NAN;
+};
+
+struct HistorySummary {
+  uint64_t rows = 0;
+  ColumnSummary download_mbps;
+  ColumnSummary upload_mbps;
+  ColumnSummary ping_ms;
+  ColumnSummary jitter_ms;
+  ColumnSummary packet_loss;
+  ColumnSummary connect_ms;
+};
+
+// Append-only columnar store of speed tests and connection attempts.
+//
+// Every column is a flat file of fixed-width values that is mmap'd and grown
+// in chunks, so appending is a handful of stores and aggregating a window is
+// a scan over contiguous arrays. Rows are ordered by timestamp, which lets
+// a window be located by binary search. The committed row count lives in a
+// separate header that is only bumped after every column has been written,
+// so a crash mid-append leaves the previous rows intact.
+class HistoryStore {
+ public:
+  explicit HistoryStore(std::string directory);
+  ~HistoryStore();
+
+  HistoryStore(const HistoryStore&) = delete;
+  HistoryStore& operator=(const HistoryStore&) = delete;
+
+  // Creates the directory if needed and maps the column files. Returns false
+  // if the store cannot be opened or its header is not recognised.
+  bool Open();
+  void Close();
+
+  bool Append(const HistoryRecord& record);
+
+  // Aggregates the rows with |from_ms| <= timestamp < |to_ms|. If |method| is
+  // not empty only rows recorded with that connection method are included.
+  HistorySummary Summarize(int64_t from_ms, int64_t to_ms,
+                           const std::string& method) const;
+
+  uint64_t rows() const;
+
+ private:
+  enum Column {
+    kTimestamp,
+    kDownload,
+    kUpload,
+    kPing,
+    kJitter,
+    kPacketLoss,
+    kConnect,
+    kMethod,
+    kColumnCount,
+  };
+
+  struct Header;
+
+  struct MappedFile {
+    int fd = -1;
+    void* data = nullptr;
+    size_t size = 0;
+  };
+
+  bool MapFile(const std::string& name, size_t size, MappedFile* file);
+  bool GrowFile(MappedFile* file, size_t size);
+  void UnmapFile(MappedFile* file);
+
+  bool Reserve(uint64_t rows);
+  bool LoadMethods();
+  uint32_t MethodId(const std::string& method);
+
+  const int64_t* timestamps() const;
+  const float* values(Column column) const;
+  const uint32_t* method_ids() const;
+  size_t LowerBound(int64_t timestamp_ms) const;
+  ColumnSummary SummarizeColumn(Column column, size_t begin, size_t end,
+                                int64_t method_id) const;
+
+  std::string directory_;
+  MappedFile header_file_;
+  MappedFile columns_[kColumnCount];
+  uint64_t capacity_ = 0;
+  std::vector<std::string> methods_;
+};
+
+#endif  // RUNNER_HISTORY_STORE_H_
@@ -1,6 +1,16 @@
+#include "headless_application.h"
 #include "my_application.h"
 
 int main(int argc, char** argv) {
+  // --headless is passed on to Dart with the other arguments; it also needs
+  // an application that does not open a display.
+  for (int i = 1; i < argc; i++) {
+    if (g_strcmp0(argv[i], "--headless") == 0) {
+      g_autoptr(HeadlessApplication) app = headless_application_new();
+      return g_application_run(G_APPLICATION(app), argc, argv);
+    }
+  }
+
   g_autoptr(MyApplication) app = my_application_new();
   return g_application_run(G_APPLICATION(app), argc, argv);
 }
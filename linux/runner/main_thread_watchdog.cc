@@ -0,0 +1,196 @@
+#include "main_thread_watchdog.h"
+
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+
+namespace {
+
+// The heartbeat fires once per threshold, but no more often than this.
+constexpr int64_t kMinHeartbeatMs = 100;
+
+// How long to wait for the main thread to answer a sample request.
+constexpr int64_t kSampleTimeoutUs = 100 * 1000;
+
+constexpr int kMaxSamplesPerStall = 8;
+constexpr int kMaxFrames = 48;
+
+// The signal handler and the signal trampoline.
+constexpr int kSkippedFrames = 2;
+
+// Handed between the watchdog thread and the signal handler, which cannot
+// take user data. Plain storage only; the handler must stay
+// async-signal-safe.
+//
+// The watchdog posts a request number; the handler claims it, fills the
+// frames and publishes the number back as answered. A handler that runs
+// after its request timed out publishes a stale number, which the next
+// request does not mistake for its own answer.
+void* g_frames[kMaxFrames];
+std::atomic<int> g_depth(0);
+std::atomic<uint32_t> g_sample_requested(0);
+std::atomic<uint32_t> g_sample_answered(0);
+
+// SIGPROF is taken by the Dart VM profiler and the first real-time signals
+// are reserved by glibc, so use one the engine leaves alone.
+int SampleSignal() { return SIGRTMIN + 6; }
+
+}  // namespace
+
+MainThreadWatchdog::MainThreadWatchdog(int64_t threshold_ms)
+    : threshold_ms_(threshold_ms),
+      heartbeat_ms_(std::max(threshold_ms, kMinHeartbeatMs)),
+      main_thread_(pthread_self()) {}
+
+MainThreadWatchdog::~MainThreadWatchdog() { Stop(); }
+
+bool MainThreadWatchdog::Start() {
+  if (thread_.joinable()) {
+    return true;
+  }
+
+  // backtrace() loads libgcc on first use, which is not safe inside a
+  // signal handler; do it now.
+  void* frames[1];
+  backtrace(frames, 1);
+
+  struct sigaction action = {};
+  action.sa_handler = OnSampleSignal;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  if (sigaction(SampleSignal(), &action, nullptr) != 0) {
+    g_warning("Failed to install stall sampling handler: %s", strerror(errno));
+    return false;
+  }
+
+  main_thread_ = pthread_self();
+  last_beat_us_ = g_get_monotonic_time();
+  heartbeat_id_ =
+      g_timeout_add(static_cast<guint>(heartbeat_ms_), OnHeartbeat, this);
+
+  stopping_ = false;
+  thread_ = std::thread(&MainThreadWatchdog::Run, this);
+  return true;
+}
+
+void MainThreadWatchdog::Stop() {
+  if (thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    stop_condition_.notify_all();
+    thread_.join();
+  }
+  if (heartbeat_id_ != 0) {
+    g_source_remove(heartbeat_id_);
+    heartbeat_id_ = 0;
+  }
+}
+
+// static
+gboolean MainThreadWatchdog::OnHeartbeat(gpointer user_data) {
+  MainThreadWatchdog* self = static_cast<MainThreadWatchdog*>(user_data);
+  self->last_beat_us_.store(g_get_monotonic_time(), std::memory_order_relaxed);
+  return G_SOURCE_CONTINUE;
+}
+
+// static
+void MainThreadWatchdog::OnSampleSignal(int signal) {
+  int saved_errno = errno;
+  uint32_t request = g_sample_requested.exchange(0);
+  if (request != 0) {
+    g_depth.store(backtrace(g_frames, kMaxFrames), std::memory_order_relaxed);
+    g_sample_answered.store(request, std::memory_order_release);
+  }
+  errno = saved_errno;
+}
+
+void MainThreadWatchdog::Run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  int64_t stalled_beat_us = 0;
+  int samples = 0;
+
+  const std::chrono::milliseconds poll_interval(threshold_ms_);
+
+  while (!stop_condition_.wait_for(lock, poll_interval,
+                                   [this] { return stopping_; })) {
+    int64_t beat_us = last_beat_us_.load(std::memory_order_relaxed);
+    int64_t stall_ms =
+        (g_get_monotonic_time() - beat_us) / 1000 - heartbeat_ms_;
+
+    if (stall_ms < threshold_ms_) {
+      if (stalled_beat_us != 0) {
+        int64_t total_ms = (beat_us - stalled_beat_us) / 1000 - heartbeat_ms_;
+        g_warning("Main thread stall ended after %" G_GINT64_FORMAT " ms",
+                  total_ms);
+        stalled_beat_us = 0;
+      }
+      continue;
+    }
+
+    if (stalled_beat_us != beat_us) {
+      stalled_beat_us = beat_us;
+      samples = 0;
+    }
+    if (samples < kMaxSamplesPerStall) {
+      lock.unlock();
+      TakeSample(stall_ms, ++samples);
+      lock.lock();
+    }
+  }
+}
+
+void MainThreadWatchdog::TakeSample(int64_t stall_ms, int index) {
+  if (++sample_sequence_ == 0) {
+    ++sample_sequence_;
+  }
+  const uint32_t request = sample_sequence_;
+  g_sample_requested.store(request);
+  if (pthread_kill(main_thread_, SampleSignal()) != 0) {
+    g_sample_requested.store(0);
+    return;
+  }
+
+  int64_t deadline_us = g_get_monotonic_time() + kSampleTimeoutUs;
+  bool answered = false;
+  while (!answered && g_get_monotonic_time() < deadline_us) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    answered = g_sample_answered.load(std::memory_order_acquire) == request;
+  }
+  int depth = answered ? g_depth.load(std::memory_order_relaxed) : 0;
+
+  g_autoptr(GDateTime) now = g_date_time_new_now_local();
+  g_autofree gchar* timestamp = g_date_time_format(now, "%F %T.%f");
+
+  if (depth <= kSkippedFrames) {
+    // Withdraw the request unless the handler has already claimed it.
+    uint32_t pending = request;
+    g_sample_requested.compare_exchange_strong(pending, 0);
+    g_warning("[%s] Main thread stalled for %" G_GINT64_FORMAT
+              " ms, no stack sample (%d/%d)",
+              timestamp, stall_ms, index, kMaxSamplesPerStall);
+    return;
+  }
+
+  std::string stack;
+  char** symbols =
+      backtrace_symbols(g_frames + kSkippedFrames, depth - kSkippedFrames);
+  for (int i = 0; i < depth - kSkippedFrames; i++) {
+    stack += "\n  #";
+    stack += std::to_string(i);
+    stack += ' ';
+    stack += symbols != nullptr ? symbols[i] : "??";
+  }
+  free(symbols);
+
+  g_warning("[%s] Main thread stalled for %" G_GINT64_FORMAT
+            " ms, stack sample %d/%d:%s",
+            timestamp, stall_ms, index, kMaxSamplesPerStall, stack.c_str());
+}
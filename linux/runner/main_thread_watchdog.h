@@ -0,0 +1,60 @@
+#ifndef RUNNER_MAIN_THREAD_WATCHDOG_H_
+#define RUNNER_MAIN_THREAD_WATCHDOG_H_
+
+#include <glib.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Detects stalls of the GTK main loop and logs where the main thread is
+// stuck.
+//
+// A timeout on the main context bumps a heartbeat; a background thread
+// checks it once per threshold and, once the heartbeat is overdue by more
+// than the threshold, interrupts the main thread with a signal whose handler
+// records a backtrace. Samples are logged with timestamps while the stall
+// lasts, and a summary is logged when it ends. When the loop is healthy the
+// cost is about one main loop wakeup and one watchdog thread wakeup per
+// threshold.
+//
+// Only one watchdog may run per process.
+class MainThreadWatchdog {
+ public:
+  // |threshold_ms| is how long the main loop may go without running before
+  // it is considered stalled.
+  explicit MainThreadWatchdog(int64_t threshold_ms);
+  ~MainThreadWatchdog();
+
+  MainThreadWatchdog(const MainThreadWatchdog&) = delete;
+  MainThreadWatchdog& operator=(const MainThreadWatchdog&) = delete;
+
+  // Must be called on the thread that runs the default main context.
+  bool Start();
+  void Stop();
+
+ private:
+  static gboolean OnHeartbeat(gpointer user_data);
+  static void OnSampleSignal(int signal);
+
+  void Run();
+  void TakeSample(int64_t stall_ms, int index);
+
+  const int64_t threshold_ms_;
+  const int64_t heartbeat_ms_;
+  pthread_t main_thread_;
+  guint heartbeat_id_ = 0;
+  std::atomic<int64_t> last_beat_us_{0};
+  // Identifies the sample request in flight; only touched by Run().
+  uint32_t sample_sequence_ = 0;
+
+  std::thread thread_;
+  std::mutex mutex_;
+  std::condition_variable stop_condition_;
+  bool stopping_ = false;
+};
+
+#endif  // RUNNER_MAIN_THREAD_WATCHDOG_H_
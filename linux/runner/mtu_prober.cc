@@ -0,0 +1,644 @@
+#include "mtu_prober.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <glib-unix.h>
+#include <ifaddrs.h>
+#include <linux/rtnetlink.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr int kIpv4HeaderSize = 20;
+constexpr int kIpv6HeaderSize = 40;
+constexpr int kIcmpHeaderSize = 8;
+constexpr int kTcpHeaderSize = 20;
+
+// Smallest MTU an IPv4 host must accept.
+constexpr int kMinimumMtu = 576;
+
+// A size counts as lost only after this many unanswered probes, so a single
+// dropped packet does not shrink the MTU.
+constexpr int kAttempts = 3;
+constexpr guint kProbeTimeoutMs = 400;
+
+// The search stops once the interval is narrower than this; a few bytes of
+// MTU are not worth another round trip.
+constexpr int kSearchStep = 8;
+
+constexpr size_t kNetlinkBufferSize = 64 * 1024;
+
+// Attributes that identify a route and where it goes; everything else in a
+// dump is state the kernel fills in itself.
+bool IsRouteKey(unsigned short type) {
+  switch (type) {
+    case RTA_DST:
+    case RTA_SRC:
+    case RTA_GATEWAY:
+    case RTA_OIF:
+    case RTA_PRIORITY:
+    case RTA_PREFSRC:
+    case RTA_TABLE:
+    case RTA_PREF:
+      return true;
+    default:
+      return false;
+  }
+}
+
+void AppendAttribute(std::vector<uint8_t>* message, unsigned short type,
+                     const void* data, size_t length) {
+  rtattr attribute = {};
+  attribute.rta_len = static_cast<unsigned short>(RTA_LENGTH(length));
+  attribute.rta_type = type;
+  size_t offset = message->size();
+  message->resize(offset + RTA_SPACE(length), 0);
+  memcpy(message->data() + offset, &attribute, sizeof(attribute));
+  memcpy(message->data() + offset + RTA_LENGTH(0), data, length);
+}
+
+int OpenRouteSocket() {
+  return socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+}
+
+bool SendToKernel(int fd, const void* message, size_t length,
+                  std::string* error) {
+  sockaddr_nl kernel = {};
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(fd, message, length, 0, reinterpret_cast<sockaddr*>(&kernel),
+             sizeof(kernel)) < 0) {
+    *error = strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+// Collects the unicast routes of every table that leave through |index|.
+bool DumpRoutes(int fd, unsigned int index,
+                std::vector<std::vector<uint8_t>>* routes,
+                std::string* error) {
+  struct {
+    nlmsghdr header;
+    rtmsg message;
+  } request = {};
+  request.header.nlmsg_len = NLMSG_LENGTH(sizeof(rtmsg));
+  request.header.nlmsg_type = RTM_GETROUTE;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.message.rtm_family = AF_UNSPEC;
+  if (!SendToKernel(fd, &request, request.header.nlmsg_len, error)) {
+    return false;
+  }
+
+  std::vector<uint8_t> buffer(kNetlinkBufferSize);
+  for (;;) {
+    ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *error = strerror(errno);
+      return false;
+    }
+    int length = static_cast<int>(received);
+    for (nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer.data());
+         NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+      if (header->nlmsg_type == NLMSG_DONE) {
+        return true;
+      }
+      if (header->nlmsg_type == NLMSG_ERROR) {
+        const nlmsgerr* failure =
+            static_cast<const nlmsgerr*>(NLMSG_DATA(header));
+        *error = strerror(-failure->error);
+        return false;
+      }
+      if (header->nlmsg_type != RTM_NEWROUTE) {
+        continue;
+      }
+      rtmsg* route = static_cast<rtmsg*>(NLMSG_DATA(header));
+      if (route->rtm_type != RTN_UNICAST) {
+        continue;
+      }
+      int attributes_length = RTM_PAYLOAD(header);
+      for (rtattr* attribute = RTM_RTA(route);
+           RTA_OK(attribute, attributes_length);
+           attribute = RTA_NEXT(attribute, attributes_length)) {
+        if (attribute->rta_type == RTA_OIF &&
+            *static_cast<uint32_t*>(RTA_DATA(attribute)) == index) {
+          const uint8_t* bytes = reinterpret_cast<const uint8_t*>(header);
+          routes->emplace_back(bytes, bytes + header->nlmsg_len);
+          break;
+        }
+      }
+    }
+  }
+}
+
+// Rewrites a dumped route as a replacement for itself. A nonzero |mtu|
+// replaces the route's MTU and advertised MSS metrics, zero keeps the
+// metrics the route was dumped with.
+std::vector<uint8_t> RouteReplacement(std::vector<uint8_t> dumped, int mtu) {
+  nlmsghdr* header = reinterpret_cast<nlmsghdr*>(dumped.data());
+  rtmsg route = *static_cast<rtmsg*>(NLMSG_DATA(header));
+
+  std::vector<uint8_t> message(NLMSG_SPACE(sizeof(rtmsg)), 0);
+  std::vector<uint8_t> metrics;
+  uint32_t locked = 0;
+  int length = RTM_PAYLOAD(header);
+  for (rtattr* attribute = RTM_RTA(NLMSG_DATA(header));
+       RTA_OK(attribute, length); attribute = RTA_NEXT(attribute, length)) {
+    if (attribute->rta_type == RTA_METRICS) {
+      int metrics_length = RTA_PAYLOAD(attribute);
+      for (rtattr* metric = static_cast<rtattr*>(RTA_DATA(attribute));
+           RTA_OK(metric, metrics_length);
+           metric = RTA_NEXT(metric, metrics_length)) {
+        if (mtu > 0 && metric->rta_type == RTAX_LOCK) {
+          memcpy(&locked, RTA_DATA(metric), sizeof(locked));
+        } else if (mtu == 0 || (metric->rta_type != RTAX_MTU &&
+                                metric->rta_type != RTAX_ADVMSS)) {
+          AppendAttribute(&metrics, metric->rta_type, RTA_DATA(metric),
+                          RTA_PAYLOAD(metric));
+        }
+      }
+    } else if (IsRouteKey(attribute->rta_type)) {
+      AppendAttribute(&message, attribute->rta_type, RTA_DATA(attribute),
+                      RTA_PAYLOAD(attribute));
+    }
+  }
+  if (mtu > 0) {
+    int headers = (route.rtm_family == AF_INET6 ? kIpv6HeaderSize
+                                                 : kIpv4HeaderSize) +
+                  kTcpHeaderSize;
+    uint32_t route_mtu = static_cast<uint32_t>(mtu);
+    uint32_t advmss = static_cast<uint32_t>(mtu - headers);
+    AppendAttribute(&metrics, RTAX_MTU, &route_mtu, sizeof(route_mtu));
+    AppendAttribute(&metrics, RTAX_ADVMSS, &advmss, sizeof(advmss));
+    // IPv6 carries route MTUs along when the interface MTU is raised unless
+    // they are locked. IPv4 leaves them alone, and a locked MTU would stop
+    // it from setting DF.
+    if (route.rtm_family == AF_INET6) {
+      locked |= 1u << RTAX_MTU;
+    }
+    if (locked != 0) {
+      AppendAttribute(&metrics, RTAX_LOCK, &locked, sizeof(locked));
+    }
+  }
+  if (!metrics.empty()) {
+    AppendAttribute(&message, RTA_METRICS, metrics.data(), metrics.size());
+  }
+
+  route.rtm_flags &= RTNH_F_ONLINK;
+  memcpy(message.data() + NLMSG_HDRLEN, &route, sizeof(route));
+  nlmsghdr out = {};
+  out.nlmsg_len = static_cast<uint32_t>(message.size());
+  out.nlmsg_type = RTM_NEWROUTE;
+  out.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | NLM_F_REPLACE;
+  memcpy(message.data(), &out, sizeof(out));
+  return message;
+}
+
+bool ReplaceRoute(int fd, const std::vector<uint8_t>& message,
+                  std::string* error) {
+  if (!SendToKernel(fd, message.data(), message.size(), error)) {
+    return false;
+  }
+  std::vector<uint8_t> buffer(kNetlinkBufferSize);
+  for (;;) {
+    ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+    if (received < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      *error = strerror(errno);
+      return false;
+    }
+    int length = static_cast<int>(received);
+    for (nlmsghdr* header = reinterpret_cast<nlmsghdr*>(buffer.data());
+         NLMSG_OK(header, length); header = NLMSG_NEXT(header, length)) {
+      if (header->nlmsg_type == NLMSG_ERROR) {
+        const nlmsgerr* ack = static_cast<const nlmsgerr*>(NLMSG_DATA(header));
+        if (ack->error != 0) {
+          *error = strerror(-ack->error);
+          return false;
+        }
+        return true;
+      }
+    }
+  }
+}
+
+}  // namespace
+
+MtuProber::MtuProber() = default;
+
+MtuProber::~MtuProber() { Cancel(); }
+
+bool MtuProber::Start(const Options& options, DoneCallback on_done) {
+  if (running()) {
+    return false;
+  }
+
+  options_ = options;
+  options_.floor = std::max(options.floor, kMinimumMtu);
+  options_.ceiling = std::max(options.ceiling, options_.floor);
+  on_done_ = std::move(on_done);
+  result_ = Result();
+  base_confirmed_ = false;
+  hint_tried_ = false;
+  hint_bounded_ = false;
+  ceiling_tried_ = false;
+  attempts_ = 0;
+  raised_ = false;
+
+  std::string error;
+  if (!OpenSocket(&error) || !FindInterface(&error)) {
+    Finish(error);
+    return true;
+  }
+
+  // Probes larger than the interface MTU never leave the host. Without
+  // permission to raise it safely the search stays below it.
+  if (options_.ceiling > original_mtu_ && !RaiseInterface()) {
+    options_.ceiling = original_mtu_;
+  }
+  options_.floor = std::min(options_.floor, options_.ceiling);
+
+  watch_id_ = g_unix_fd_add(
+      fd_, static_cast<GIOCondition>(G_IO_IN | G_IO_ERR | G_IO_HUP),
+      OnSocketReadable, this);
+
+  size_ = options_.floor;
+  SendProbe();
+  return true;
+}
+
+void MtuProber::Cancel() {
+  if (!running()) {
+    return;
+  }
+  on_done_ = nullptr;
+  if (raised_) {
+    SettleInterface(original_mtu_);
+  }
+  Reset();
+}
+
+// static
+gboolean MtuProber::OnSocketReadable(gint fd, GIOCondition condition,
+                                     gpointer user_data) {
+  MtuProber* self = static_cast<MtuProber*>(user_data);
+
+  if (condition & (G_IO_ERR | G_IO_HUP)) {
+    // Errors are also reported through recv() below; only give up if the
+    // socket itself is gone.
+    if (!(condition & G_IO_IN) && (condition & G_IO_HUP)) {
+      self->watch_id_ = 0;
+      self->Finish("Probe socket closed");
+      return G_SOURCE_REMOVE;
+    }
+  }
+
+  std::vector<uint8_t> buffer(self->options_.ceiling);
+  for (;;) {
+    ssize_t length = recv(fd, buffer.data(), buffer.size(), 0);
+    if (length < 0) {
+      if (errno == EMSGSIZE && self->timeout_id_ != 0) {
+        // The path reported the probe as too big.
+        self->OnProbeAnswered(false);
+        if (!self->running()) {
+          return G_SOURCE_REMOVE;
+        }
+        continue;
+      }
+      // Unreachable and similar errors belong to whichever probe triggered
+      // them; let that probe time out instead.
+      break;
+    }
+
+    if (length < kIcmpHeaderSize || self->timeout_id_ == 0) {
+      continue;
+    }
+    icmphdr header;
+    memcpy(&header, buffer.data(), sizeof(header));
+    if (header.type == ICMP_ECHOREPLY &&
+        ntohs(header.un.echo.sequence) == self->sequence_ &&
+        length == self->size_ - kIpv4HeaderSize) {
+      self->OnProbeAnswered(true);
+      if (!self->running()) {
+        return G_SOURCE_REMOVE;
+      }
+    }
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+// static
+gboolean MtuProber::OnProbeTimeout(gpointer user_data) {
+  MtuProber* self = static_cast<MtuProber*>(user_data);
+  self->timeout_id_ = 0;
+  if (++self->attempts_ < kAttempts) {
+    self->SendProbe();
+  } else {
+    self->OnProbeAnswered(false);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+bool MtuProber::OpenSocket(std::string* error) {
+  in_addr target;
+  if (inet_pton(AF_INET, options_.target.c_str(), &target) != 1) {
+    *error = "Invalid probe target " + options_.target;
+    return false;
+  }
+
+  // Ping sockets need no privileges as long as the group is allowed by
+  // net.ipv4.ping_group_range, which it is on common desktop distributions.
+  fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               IPPROTO_ICMP);
+  if (fd_ < 0) {
+    *error = std::string("Failed to open ping socket: ") + strerror(errno);
+    return false;
+  }
+
+  // Set DF and ignore the cached path MTU so every probe tests its own size.
+  int discover = IP_PMTUDISC_PROBE;
+  if (setsockopt(fd_, IPPROTO_IP, IP_MTU_DISCOVER, &discover,
+                 sizeof(discover)) != 0) {
+    *error = std::string("Failed to set DF on probes: ") + strerror(errno);
+    return false;
+  }
+
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr = target;
+  if (connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) !=
+      0) {
+    *error = std::string("Failed to route probes: ") + strerror(errno);
+    return false;
+  }
+  return true;
+}
+
+bool MtuProber::FindInterface(std::string* error) {
+  sockaddr_in local = {};
+  socklen_t local_length = sizeof(local);
+  if (getsockname(fd_, reinterpret_cast<sockaddr*>(&local), &local_length) !=
+      0) {
+    *error = std::string("Failed to read probe source: ") + strerror(errno);
+    return false;
+  }
+
+  ifaddrs* interfaces = nullptr;
+  if (getifaddrs(&interfaces) != 0) {
+    *error = std::string("Failed to list interfaces: ") + strerror(errno);
+    return false;
+  }
+  for (ifaddrs* entry = interfaces; entry != nullptr;
+       entry = entry->ifa_next) {
+    if (entry->ifa_addr == nullptr || entry->ifa_addr->sa_family != AF_INET) {
+      continue;
+    }
+    const sockaddr_in* address =
+        reinterpret_cast<const sockaddr_in*>(entry->ifa_addr);
+    if (address->sin_addr.s_addr == local.sin_addr.s_addr &&
+        (entry->ifa_flags & IFF_POINTOPOINT)) {
+      result_.interface = entry->ifa_name;
+      break;
+    }
+  }
+  freeifaddrs(interfaces);
+
+  if (result_.interface.empty()) {
+    *error = options_.target + " is not routed through the tunnel";
+    return false;
+  }
+  interface_index_ = if_nametoindex(result_.interface.c_str());
+
+  ifreq request = {};
+  g_strlcpy(request.ifr_name, result_.interface.c_str(),
+            sizeof(request.ifr_name));
+  if (ioctl(fd_, SIOCGIFMTU, &request) != 0) {
+    *error = std::string("Failed to read tunnel MTU: ") + strerror(errno);
+    return false;
+  }
+  original_mtu_ = request.ifr_mtu;
+  return true;
+}
+
+bool MtuProber::SetInterfaceMtu(int mtu) {
+  if (if_nametoindex(result_.interface.c_str()) != interface_index_) {
+    g_warning("%s went away while probing its MTU", result_.interface.c_str());
+    return false;
+  }
+
+  ifreq request = {};
+  g_strlcpy(request.ifr_name, result_.interface.c_str(),
+            sizeof(request.ifr_name));
+  request.ifr_mtu = mtu;
+  if (ioctl(fd_, SIOCSIFMTU, &request) != 0) {
+    g_warning("Failed to set MTU of %s to %d: %s", result_.interface.c_str(),
+              mtu, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool MtuProber::RaiseInterface() {
+  if (!ClampRoutes(original_mtu_)) {
+    return false;
+  }
+  if (!SetInterfaceMtu(options_.ceiling)) {
+    RestoreRoutes();
+    return false;
+  }
+  raised_ = true;
+  return true;
+}
+
+bool MtuProber::SettleInterface(int mtu) {
+  bool applied = SetInterfaceMtu(mtu);
+  if (raised_) {
+    // While the interface is still at the ceiling the clamp is all that
+    // keeps TCP to sizes known to work, so it stays.
+    if (applied) {
+      RestoreRoutes();
+    }
+    routes_.clear();
+    raised_ = false;
+  }
+  return applied;
+}
+
+bool MtuProber::ClampRoutes(int mtu) {
+  routes_.clear();
+  int fd = OpenRouteSocket();
+  if (fd < 0) {
+    g_warning("Failed to open netlink socket: %s", strerror(errno));
+    return false;
+  }
+
+  std::string error;
+  size_t clamped = 0;
+  if (DumpRoutes(fd, interface_index_, &routes_, &error)) {
+    if (routes_.empty()) {
+      error = "no route through it can be clamped";
+    }
+    while (clamped < routes_.size() &&
+           ReplaceRoute(fd, RouteReplacement(routes_[clamped], mtu), &error)) {
+      clamped++;
+    }
+  }
+
+  bool ok = !routes_.empty() && clamped == routes_.size();
+  if (!ok) {
+    g_warning("Not probing %s above its MTU of %d: %s",
+              result_.interface.c_str(), original_mtu_, error.c_str());
+    routes_.resize(clamped);
+    std::string ignored;
+    for (const std::vector<uint8_t>& route : routes_) {
+      ReplaceRoute(fd, RouteReplacement(route, 0), &ignored);
+    }
+    routes_.clear();
+  }
+  close(fd);
+  return ok;
+}
+
+void MtuProber::RestoreRoutes() {
+  int fd = OpenRouteSocket();
+  if (fd < 0) {
+    g_warning("Failed to open netlink socket: %s", strerror(errno));
+    routes_.clear();
+    return;
+  }
+  for (const std::vector<uint8_t>& route : routes_) {
+    std::string error;
+    if (!ReplaceRoute(fd, RouteReplacement(route, 0), &error)) {
+      g_warning("Failed to restore a route through %s: %s",
+                result_.interface.c_str(), error.c_str());
+    }
+  }
+  close(fd);
+  routes_.clear();
+}
+
+void MtuProber::SendProbe() {
+  std::vector<uint8_t> packet(size_ - kIpv4HeaderSize, 0);
+  icmphdr header = {};
+  header.type = ICMP_ECHO;
+  // The kernel fills in the identifier and checksum on ping sockets.
+  header.un.echo.sequence = htons(++sequence_);
+  memcpy(packet.data(), &header, sizeof(header));
+
+  result_.probes++;
+  timeout_id_ = g_timeout_add(kProbeTimeoutMs, OnProbeTimeout, this);
+
+  if (send(fd_, packet.data(), packet.size(), 0) < 0 && errno == EMSGSIZE) {
+    // Larger than the interface allows; no need to wait.
+    OnProbeAnswered(false);
+  }
+}
+
+void MtuProber::OnProbeAnswered(bool passed) {
+  if (timeout_id_ != 0) {
+    g_source_remove(timeout_id_);
+    timeout_id_ = 0;
+  }
+  attempts_ = 0;
+
+  if (!base_confirmed_) {
+    if (!passed) {
+      Finish("The tunnel does not carry " + std::to_string(size_) +
+             " byte packets");
+      return;
+    }
+    base_confirmed_ = true;
+    low_ = size_;
+    high_ = options_.ceiling;
+  } else if (passed) {
+    low_ = size_;
+  } else {
+    high_ = size_ - 1;
+  }
+  NextSize();
+}
+
+void MtuProber::NextSize() {
+  if (!hint_tried_) {
+    hint_tried_ = true;
+    if (options_.hint > low_ && options_.hint <= high_) {
+      size_ = options_.hint;
+      SendProbe();
+      return;
+    }
+  } else if (!hint_bounded_) {
+    // The path usually has not changed since the last connect; one probe
+    // just above the hint is then enough to settle the search.
+    hint_bounded_ = true;
+    if (low_ == options_.hint && low_ + kSearchStep <= high_) {
+      size_ = low_ + kSearchStep;
+      SendProbe();
+      return;
+    }
+  }
+
+  // Most tunnels already carry what their interface is configured for;
+  // confirming that takes one probe instead of a search.
+  if (!ceiling_tried_) {
+    ceiling_tried_ = true;
+    if (high_ == options_.ceiling && low_ < high_) {
+      size_ = high_;
+      SendProbe();
+      return;
+    }
+  }
+
+  if (high_ - low_ < kSearchStep) {
+    Finish("");
+    return;
+  }
+  size_ = low_ + (high_ - low_ + 1) / 2;
+  SendProbe();
+}
+
+void MtuProber::Finish(const std::string& error) {
+  if (error.empty()) {
+    result_.mtu = low_;
+    result_.mss = low_ - kIpv4HeaderSize - kTcpHeaderSize;
+    result_.applied =
+        (!raised_ && low_ == original_mtu_) || SettleInterface(low_);
+  } else if (raised_) {
+    SettleInterface(original_mtu_);
+  }
+
+  DoneCallback on_done = std::move(on_done_);
+  on_done_ = nullptr;
+  Reset();
+  if (on_done) {
+    on_done(result_, error);
+  }
+}
+
+void MtuProber::Reset() {
+  if (timeout_id_ != 0) {
+    g_source_remove(timeout_id_);
+    timeout_id_ = 0;
+  }
+  if (watch_id_ != 0) {
+    g_source_remove(watch_id_);
+    watch_id_ = 0;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+}
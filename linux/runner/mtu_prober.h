@@ -0,0 +1,133 @@
+#ifndef RUNNER_MTU_PROBER_H_
+#define RUNNER_MTU_PROBER_H_
+
+#include <glib.h>
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// Finds the largest packet that makes it through the VPN tunnel and retunes
+// the tunnel interface to it, in the spirit of packetization-layer path MTU
+// discovery (RFC 8899).
+//
+// Probes are ICMP echo requests sent with the don't-fragment bit from an
+// unprivileged ping socket to a host routed through the tunnel, so no probe
+// depends on ICMP "fragmentation needed" messages making it back. The base
+// size is confirmed first, then the previous result for the same connection
+// method if there is one, then the interface's current MTU, and the rest of
+// the range is binary-searched. The tunnel interface is the point-to-point
+// interface the probe socket is routed through, and is set to the result.
+// TCP derives its MSS from the interface MTU, so that is retuned along with
+// it.
+//
+// Probing above the interface's current MTU means raising the interface to
+// the ceiling first. While it is raised, the routes through the tunnel are
+// clamped to the old MTU and its MSS through their route metrics, so TCP
+// keeps to sizes known to work; probes ignore route MTUs and are limited by
+// the interface alone. Once the search is over the interface is set to the
+// result and the routes are put back. Raising the interface and changing
+// routes both need CAP_NET_ADMIN. Without it only sizes up to the current
+// MTU are probed, and a smaller result is reported but not applied.
+//
+// Runs on the main context it was started from.
+class MtuProber {
+ public:
+  struct Options {
+    // IPv4 host that answers ping and is reached through the tunnel.
+    std::string target = "1.1.1.1";
+    // The IPv6 minimum; every tunnel is expected to carry it.
+    int floor = 1280;
+    // Sizes above the interface's current MTU need CAP_NET_ADMIN.
+    int ceiling = 1500;
+    // Result of an earlier probe over the same connection method, tried
+    // right after the base size. Zero if there is none.
+    int hint = 0;
+  };
+
+  struct Result {
+    std::string interface;
+    int mtu = 0;
+    int mss = 0;
+    int probes = 0;
+    // False if the interface MTU could not be changed, usually for lack of
+    // CAP_NET_ADMIN; |mtu| is still the probed value.
+    bool applied = false;
+  };
+
+  // |error| is empty on success.
+  using DoneCallback =
+      std::function<void(const Result& result, const std::string& error)>;
+
+  MtuProber();
+  ~MtuProber();
+
+  MtuProber(const MtuProber&) = delete;
+  MtuProber& operator=(const MtuProber&) = delete;
+
+  // Starts probing; |on_done| is called exactly once unless Cancel() is
+  // called first, before Start() returns if the probe socket cannot be set
+  // up. Returns false if a probe is already running.
+  bool Start(const Options& options, DoneCallback on_done);
+
+  // Stops probing without calling |on_done|, and puts back the interface MTU
+  // and routes if they were changed for probing.
+  void Cancel();
+
+  bool running() const { return fd_ >= 0; }
+
+ private:
+  static gboolean OnSocketReadable(gint fd, GIOCondition condition,
+                                   gpointer user_data);
+  static gboolean OnProbeTimeout(gpointer user_data);
+
+  bool OpenSocket(std::string* error);
+  bool FindInterface(std::string* error);
+  bool SetInterfaceMtu(int mtu);
+  // Clamps the routes through the tunnel and raises the interface to the
+  // ceiling; false if either is not permitted, with nothing left changed.
+  bool RaiseInterface();
+  // Sets the interface to |mtu| and, once it is no longer raised, lifts the
+  // route clamp.
+  bool SettleInterface(int mtu);
+  bool ClampRoutes(int mtu);
+  void RestoreRoutes();
+
+  // Sends an echo request of |mtu| bytes on the wire.
+  void SendProbe();
+  void OnProbeAnswered(bool passed);
+  // Picks the next size to try, or finishes once the search has converged.
+  void NextSize();
+  void Finish(const std::string& error);
+  void Reset();
+
+  Options options_;
+  DoneCallback on_done_;
+  Result result_;
+
+  int fd_ = -1;
+  guint watch_id_ = 0;
+  guint timeout_id_ = 0;
+  // The tunnel interface may go away while probing and its name be reused.
+  unsigned int interface_index_ = 0;
+  int original_mtu_ = 0;
+  bool raised_ = false;
+  // Netlink messages of the routes through the tunnel as they were before
+  // being clamped.
+  std::vector<std::vector<uint8_t>> routes_;
+
+  // The search interval: |low_| is known to pass, sizes above |high_| are
+  // known to fail.
+  int low_ = 0;
+  int high_ = 0;
+  int size_ = 0;
+  int attempts_ = 0;
+  bool base_confirmed_ = false;
+  bool hint_tried_ = false;
+  bool hint_bounded_ = false;
+  bool ceiling_tried_ = false;
+  uint16_t sequence_ = 0;
+};
+
+#endif  // RUNNER_MTU_PROBER_H_
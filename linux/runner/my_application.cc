@@ -5,11 +5,21 @@
 #include <gdk/gdkx.h>
 #endif
 
+#include <stdlib.h>
+
 #include "flutter/generated_plugin_registrant.h"
+#include "main_thread_watchdog.h"
+#include "vpn_channel.h"
+
+// Main loop stalls longer than this are logged with stack samples. Can be
+// overridden with DEFYX_STALL_THRESHOLD_MS; 0 disables the watchdog.
+static constexpr int64_t kDefaultStallThresholdMs = 250;
 
 struct _MyApplication {
   GtkApplication parent_instance;
   char** dart_entrypoint_arguments;
+  VpnChannel* vpn_channel;
+  MainThreadWatchdog* watchdog;
 };
 
 G_DEFINE_TYPE(MyApplication, my_application, GTK_TYPE_APPLICATION)
@@ -17,6 +27,15 @@ G_DEFINE_TYPE(MyApplication, my_application, GTK_TYPE_APPLICATION)
 // Implements GApplication::activate.
 static void my_application_activate(GApplication* application) {
   MyApplication* self = MY_APPLICATION(application);
+
+  // Later launches are handed to this instance; show the window that is
+  // already running rather than starting a second engine.
+  GList* windows = gtk_application_get_windows(GTK_APPLICATION(application));
+  if (windows != nullptr) {
+    gtk_window_present(GTK_WINDOW(windows->data));
+    return;
+  }
+
   GtkWindow* window =
       GTK_WINDOW(gtk_application_window_new(GTK_APPLICATION(application)));
 
@@ -59,42 +78,63 @@ static void my_application_activate(GApplication* application) {
 
   fl_register_plugins(FL_PLUGIN_REGISTRY(view));
 
+  FlEngine* engine = fl_view_get_engine(view);
+  self->vpn_channel =
+      vpn_channel_new(fl_engine_get_binary_messenger(engine));
+
   gtk_widget_grab_focus(GTK_WIDGET(view));
 }
 
-// Implements GApplication::local_command_line.
-static gboolean my_application_local_command_line(GApplication* application, gchar*** arguments, int* exit_status) {
+// Implements GApplication::command_line.
+//
+// Called in the primary instance, for its own launch and for every later
+// launch, which GApplication forwards over D-Bus before exiting.
+static int my_application_command_line(GApplication* application,
+                                       GApplicationCommandLine* command_line) {
   MyApplication* self = MY_APPLICATION(application);
-  // Strip out the first argument as it is the binary name.
-  self->dart_entrypoint_arguments = g_strdupv(*arguments + 1);
-
-  g_autoptr(GError) error = nullptr;
-  if (!g_application_register(application, nullptr, &error)) {
-     g_warning("Failed to register: %s", error->message);
-     *exit_status = 1;
-     return TRUE;
+
+  int argc = 0;
+  g_auto(GStrv) arguments =
+      g_application_command_line_get_arguments(command_line, &argc);
+  if (!g_application_command_line_get_is_remote(command_line)) {
+    // Strip out the first argument as it is the binary name.
+    self->dart_entrypoint_arguments = g_strdupv(arguments + 1);
+  } else if (argc > 1) {
+    g_autofree gchar* forwarded = g_strjoinv(" ", arguments + 1);
+    g_message("Already running; ignoring arguments: %s", forwarded);
   }
 
   g_application_activate(application);
-  *exit_status = 0;
-
-  return TRUE;
+  return 0;
 }
 
 // Implements GApplication::startup.
 static void my_application_startup(GApplication* application) {
-  //MyApplication* self = MY_APPLICATION(object);
+  MyApplication* self = MY_APPLICATION(application);
 
   // Perform any actions required at application startup.
+  int64_t threshold_ms = kDefaultStallThresholdMs;
+  const gchar* threshold = g_getenv("DEFYX_STALL_THRESHOLD_MS");
+  if (threshold != nullptr) {
+    threshold_ms = g_ascii_strtoll(threshold, nullptr, 10);
+  }
+  if (threshold_ms > 0) {
+    self->watchdog = new MainThreadWatchdog(threshold_ms);
+    self->watchdog->Start();
+  }
 
   G_APPLICATION_CLASS(my_application_parent_class)->startup(application);
 }
 
 // Implements GApplication::shutdown.
 static void my_application_shutdown(GApplication* application) {
-  //MyApplication* self = MY_APPLICATION(object);
+  MyApplication* self = MY_APPLICATION(application);
 
   // Perform any actions required at application shutdown.
+  if (self->watchdog != nullptr) {
+    delete self->watchdog;
+    self->watchdog = nullptr;
+  }
 
   G_APPLICATION_CLASS(my_application_parent_class)->shutdown(application);
 }
@@ -103,12 +143,13 @@ static void my_application_shutdown(GApplication* application) {
 static void my_application_dispose(GObject* object) {
   MyApplication* self = MY_APPLICATION(object);
   g_clear_pointer(&self->dart_entrypoint_arguments, g_strfreev);
+  g_clear_object(&self->vpn_channel);
   G_OBJECT_CLASS(my_application_parent_class)->dispose(object);
 }
 
 static void my_application_class_init(MyApplicationClass* klass) {
   G_APPLICATION_CLASS(klass)->activate = my_application_activate;
-  G_APPLICATION_CLASS(klass)->local_command_line = my_application_local_command_line;
+  G_APPLICATION_CLASS(klass)->command_line = my_application_command_line;
   G_APPLICATION_CLASS(klass)->startup = my_application_startup;
   G_APPLICATION_CLASS(klass)->shutdown = my_application_shutdown;
   G_OBJECT_CLASS(klass)->dispose = my_application_dispose;
@@ -125,6 +166,6 @@ MyApplication* my_application_new() {
 
   return MY_APPLICATION(g_object_new(my_application_get_type(),
                                      "application-id", APPLICATION_ID,
-                                     "flags", G_APPLICATION_NON_UNIQUE,
+                                     "flags", G_APPLICATION_HANDLES_COMMAND_LINE,
                                      nullptr));
 }
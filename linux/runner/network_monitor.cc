@@ -0,0 +1,328 @@
+#include "network_monitor.h"
+
+#include <errno.h>
+#include <glib-unix.h>
+#include <linux/if.h>
+#include <linux/if_addr.h>
+#include <linux/rtnetlink.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace {
+
+// Quiet period after the last relevant event before the change is reported.
+// Roaming produces a burst of link, address and route messages over a few
+// hundred milliseconds; reporting only once keeps us from reconnecting
+// halfway through it.
+constexpr guint kDebounceMs = 800;
+
+constexpr size_t kReceiveBufferSize = 32 * 1024;
+
+}  // namespace
+
+NetworkMonitor::NetworkMonitor(ChangeCallback on_change)
+    : on_change_(std::move(on_change)) {}
+
+NetworkMonitor::~NetworkMonitor() { Stop(); }
+
+bool NetworkMonitor::Start() {
+  if (fd_ >= 0) {
+    return true;
+  }
+
+  fd_ = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+               NETLINK_ROUTE);
+  if (fd_ < 0) {
+    g_warning("Failed to open netlink socket: %s", strerror(errno));
+    return false;
+  }
+
+  sockaddr_nl address = {};
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                      RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE;
+  if (bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    g_warning("Failed to bind netlink socket: %s", strerror(errno));
+    Stop();
+    return false;
+  }
+
+  primed_ = false;
+  if (!RequestDump(RTM_GETLINK)) {
+    Stop();
+    return false;
+  }
+
+  watch_id_ = g_unix_fd_add(
+      fd_, static_cast<GIOCondition>(G_IO_IN | G_IO_ERR | G_IO_HUP),
+      OnSocketReadable, this);
+  return true;
+}
+
+void NetworkMonitor::Stop() {
+  if (debounce_id_ != 0) {
+    g_source_remove(debounce_id_);
+    debounce_id_ = 0;
+  }
+  if (watch_id_ != 0) {
+    g_source_remove(watch_id_);
+    watch_id_ = 0;
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+    fd_ = -1;
+  }
+  links_.clear();
+  default_routes_.clear();
+  pending_dump_ = 0;
+  primed_ = false;
+}
+
+bool NetworkMonitor::RequestDump(int type) {
+  struct {
+    nlmsghdr header;
+    rtgenmsg message;
+  } request = {};
+  request.header.nlmsg_len = NLMSG_LENGTH(sizeof(rtgenmsg));
+  request.header.nlmsg_type = type;
+  request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+  request.header.nlmsg_seq = ++sequence_;
+  request.message.rtgen_family = AF_UNSPEC;
+
+  sockaddr_nl kernel = {};
+  kernel.nl_family = AF_NETLINK;
+  if (sendto(fd_, &request, request.header.nlmsg_len, 0,
+             reinterpret_cast<sockaddr*>(&kernel), sizeof(kernel)) < 0) {
+    g_warning("Failed to request netlink dump: %s", strerror(errno));
+    return false;
+  }
+  pending_dump_ = type;
+  return true;
+}
+
+// static
+gboolean NetworkMonitor::OnSocketReadable(gint fd, GIOCondition condition,
+                                          gpointer user_data) {
+  NetworkMonitor* self = static_cast<NetworkMonitor*>(user_data);
+  if (condition & (G_IO_ERR | G_IO_HUP)) {
+    g_warning("Netlink socket closed, network changes will not be tracked");
+    self->watch_id_ = 0;
+    return G_SOURCE_REMOVE;
+  }
+
+  char buffer[kReceiveBufferSize];
+  bool changed = false;
+  for (;;) {
+    ssize_t length = recv(fd, buffer, sizeof(buffer), 0);
+    if (length < 0) {
+      if (errno == ENOBUFS) {
+        // The kernel dropped notifications; treat it as a change so the
+        // tunnel is revalidated rather than silently left on a dead path.
+        changed = self->primed_;
+        continue;
+      }
+      break;
+    }
+    if (length == 0) {
+      break;
+    }
+    changed |= self->HandleMessages(buffer, static_cast<size_t>(length));
+  }
+
+  if (changed) {
+    self->ScheduleNotify();
+  }
+  return G_SOURCE_CONTINUE;
+}
+
+// static
+gboolean NetworkMonitor::OnDebounceElapsed(gpointer user_data) {
+  NetworkMonitor* self = static_cast<NetworkMonitor*>(user_data);
+  self->debounce_id_ = 0;
+
+  // Links going down produce events too; wait until a usable default route
+  // is back before asking anyone to reconnect.
+  if (self->HasDefaultRoute()) {
+    self->on_change_(self->last_interface_);
+  }
+  return G_SOURCE_REMOVE;
+}
+
+bool NetworkMonitor::HandleMessages(const char* buffer, size_t length) {
+  bool changed = false;
+  const nlmsghdr* header = reinterpret_cast<const nlmsghdr*>(buffer);
+  int remaining = static_cast<int>(length);
+
+  for (; NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+    // Replies to the initial dumps only seed the link, address and route
+    // tables.
+    bool relevant = false;
+    switch (header->nlmsg_type) {
+      case NLMSG_DONE:
+        if (pending_dump_ == RTM_GETLINK) {
+          RequestDump(RTM_GETADDR);
+        } else if (pending_dump_ == RTM_GETADDR) {
+          RequestDump(RTM_GETROUTE);
+        } else if (pending_dump_ == RTM_GETROUTE) {
+          pending_dump_ = 0;
+          primed_ = true;
+        }
+        break;
+      case NLMSG_ERROR:
+        break;
+      case RTM_NEWLINK:
+      case RTM_DELLINK:
+        relevant = HandleLink(header);
+        break;
+      case RTM_NEWADDR:
+      case RTM_DELADDR:
+        relevant = HandleAddress(header);
+        break;
+      case RTM_NEWROUTE:
+      case RTM_DELROUTE:
+        relevant = HandleRoute(header);
+        break;
+      default:
+        break;
+    }
+    changed |= relevant && primed_;
+  }
+  return changed;
+}
+
+bool NetworkMonitor::HandleLink(const nlmsghdr* header) {
+  const ifinfomsg* info = static_cast<const ifinfomsg*>(NLMSG_DATA(header));
+  int index = info->ifi_index;
+
+  if (header->nlmsg_type == RTM_DELLINK) {
+    auto it = links_.find(index);
+    if (it == links_.end()) {
+      return false;
+    }
+    bool relevant = !it->second.ignored;
+    if (relevant) {
+      last_interface_ = it->second.name;
+    }
+    links_.erase(it);
+    return relevant;
+  }
+
+  Link& link = links_[index];
+  link.ignored = (info->ifi_flags & (IFF_LOOPBACK | IFF_POINTOPOINT)) != 0;
+
+  int attributes_length = IFLA_PAYLOAD(header);
+  for (const rtattr* attribute = IFLA_RTA(info);
+       RTA_OK(attribute, attributes_length);
+       attribute = RTA_NEXT(attribute, attributes_length)) {
+    if (attribute->rta_type == IFLA_IFNAME) {
+      link.name = static_cast<const char*>(RTA_DATA(attribute));
+    }
+  }
+
+  // NEWLINK is also sent for statistics and flag churn; only carrier
+  // transitions matter here.
+  bool running = (info->ifi_flags & IFF_RUNNING) != 0;
+  bool relevant = !link.ignored && running != link.running;
+  link.running = running;
+  if (relevant) {
+    last_interface_ = link.name;
+  }
+  return relevant;
+}
+
+bool NetworkMonitor::HandleAddress(const nlmsghdr* header) {
+  const ifaddrmsg* info = static_cast<const ifaddrmsg*>(NLMSG_DATA(header));
+  if (info->ifa_scope != RT_SCOPE_UNIVERSE || IsIgnored(info->ifa_index)) {
+    return false;
+  }
+
+  // IFA_LOCAL is the interface's own address where it differs from
+  // IFA_ADDRESS, which is then the peer.
+  const rtattr* address = nullptr;
+  int attributes_length = IFA_PAYLOAD(header);
+  for (const rtattr* attribute = IFA_RTA(info);
+       RTA_OK(attribute, attributes_length);
+       attribute = RTA_NEXT(attribute, attributes_length)) {
+    if (attribute->rta_type == IFA_LOCAL ||
+        (attribute->rta_type == IFA_ADDRESS && address == nullptr)) {
+      address = attribute;
+    }
+  }
+  if (address == nullptr) {
+    return false;
+  }
+
+  std::string key;
+  key.push_back(static_cast<char>(info->ifa_family));
+  key.push_back(static_cast<char>(info->ifa_prefixlen));
+  key.append(static_cast<const char*>(RTA_DATA(address)),
+             RTA_PAYLOAD(address));
+
+  // The kernel repeats NEWADDR whenever an address' lifetimes are refreshed,
+  // on every router advertisement and DHCP renewal; only addresses coming
+  // and going are changes.
+  std::set<std::string>& addresses = links_[info->ifa_index].addresses;
+  bool changed = header->nlmsg_type == RTM_NEWADDR
+                     ? addresses.insert(key).second
+                     : addresses.erase(key) > 0;
+  if (changed) {
+    last_interface_ = InterfaceName(info->ifa_index);
+  }
+  return changed;
+}
+
+bool NetworkMonitor::HandleRoute(const nlmsghdr* header) {
+  const rtmsg* info = static_cast<const rtmsg*>(NLMSG_DATA(header));
+  if (info->rtm_table != RT_TABLE_MAIN || info->rtm_dst_len != 0 ||
+      info->rtm_type != RTN_UNICAST) {
+    return false;
+  }
+
+  int output_interface = 0;
+  unsigned int priority = 0;
+  int attributes_length = RTM_PAYLOAD(header);
+  for (const rtattr* attribute = RTM_RTA(info);
+       RTA_OK(attribute, attributes_length);
+       attribute = RTA_NEXT(attribute, attributes_length)) {
+    if (attribute->rta_type == RTA_OIF) {
+      output_interface = *static_cast<const int*>(RTA_DATA(attribute));
+    } else if (attribute->rta_type == RTA_PRIORITY) {
+      priority = *static_cast<const unsigned int*>(RTA_DATA(attribute));
+    }
+  }
+  if (output_interface == 0 || IsIgnored(output_interface)) {
+    return false;
+  }
+
+  // Route daemons re-add unchanged default routes on renewals as well.
+  RouteKey key(info->rtm_family, output_interface, priority);
+  bool changed = header->nlmsg_type == RTM_NEWROUTE
+                     ? default_routes_.insert(key).second
+                     : default_routes_.erase(key) > 0;
+  if (changed) {
+    last_interface_ = InterfaceName(output_interface);
+  }
+  return changed;
+}
+
+bool NetworkMonitor::IsIgnored(int index) const {
+  auto it = links_.find(index);
+  return it != links_.end() && it->second.ignored;
+}
+
+std::string NetworkMonitor::InterfaceName(int index) const {
+  auto it = links_.find(index);
+  return it != links_.end() ? it->second.name : std::string();
+}
+
+bool NetworkMonitor::HasDefaultRoute() const { return !default_routes_.empty(); }
+
+void NetworkMonitor::ScheduleNotify() {
+  if (debounce_id_ != 0) {
+    g_source_remove(debounce_id_);
+  }
+  debounce_id_ = g_timeout_add(kDebounceMs, OnDebounceElapsed, this);
+}
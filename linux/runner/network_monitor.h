@@ -0,0 +1,86 @@
+#ifndef RUNNER_NETWORK_MONITOR_H_
+#define RUNNER_NETWORK_MONITOR_H_
+
+#include <glib.h>
+#include <linux/netlink.h>
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <tuple>
+
+// Watches RTNETLINK for link, address and default-route changes on physical
+// interfaces and reports them, debounced, on the main context it was started
+// from.
+//
+// Point-to-point and loopback interfaces are ignored so that the VPN tunnel
+// itself coming up or down never looks like a network change.
+class NetworkMonitor {
+ public:
+  // Called once per burst of changes, after the network has settled and a
+  // default route is available again. |interface| is the name of the last
+  // interface that changed.
+  using ChangeCallback = std::function<void(const std::string& interface)>;
+
+  explicit NetworkMonitor(ChangeCallback on_change);
+  ~NetworkMonitor();
+
+  NetworkMonitor(const NetworkMonitor&) = delete;
+  NetworkMonitor& operator=(const NetworkMonitor&) = delete;
+
+  // Opens the netlink socket, dumps the current links, addresses and routes
+  // and starts listening for changes. Returns false if the socket could not
+  // be opened.
+  bool Start();
+
+  // Closes the socket and drops any pending notification.
+  void Stop();
+
+ private:
+  // Keyed by address family, output interface and route priority.
+  using RouteKey = std::tuple<unsigned char, int, unsigned int>;
+
+  struct Link {
+    std::string name;
+    bool ignored = false;
+    bool running = false;
+    // Universe-scope addresses as family, prefix length and address bytes.
+    std::set<std::string> addresses;
+  };
+
+  static gboolean OnSocketReadable(gint fd, GIOCondition condition,
+                                   gpointer user_data);
+  static gboolean OnDebounceElapsed(gpointer user_data);
+
+  // Requests a dump of all links, addresses or routes. Replies arrive on the
+  // same socket and are parsed like regular notifications.
+  bool RequestDump(int type);
+
+  // Parses one datagram. Returns true if it contained a relevant change.
+  bool HandleMessages(const char* buffer, size_t length);
+  bool HandleLink(const nlmsghdr* header);
+  bool HandleAddress(const nlmsghdr* header);
+  bool HandleRoute(const nlmsghdr* header);
+
+  bool IsIgnored(int index) const;
+  std::string InterfaceName(int index) const;
+  bool HasDefaultRoute() const;
+  void ScheduleNotify();
+
+  ChangeCallback on_change_;
+  int fd_ = -1;
+  guint watch_id_ = 0;
+  guint debounce_id_ = 0;
+  unsigned int sequence_ = 0;
+
+  // Changes are only reported once the initial dumps have been consumed.
+  bool primed_ = false;
+  int pending_dump_ = 0;
+
+  std::map<int, Link> links_;
+  std::set<RouteKey> default_routes_;
+  std::string last_interface_;
+};
+
+#endif  // RUNNER_NETWORK_MONITOR_H_
@@ -0,0 +1,307 @@
+#include "secret_cache.h"
+
+#include <errno.h>
+#include <libsecret/secret.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <utility>
+
+namespace {
+
+// Coalesces the writes made while connecting, e.g. the three entries saved
+// after every successful connect, into a single keyring update.
+constexpr guint kWriteBackDelayMs = 1500;
+
+// Up to 20 digits and a colon.
+constexpr size_t kMaxPrefixLength = 21;
+
+constexpr char kLabel[] = "Defyx VPN";
+constexpr char kStoreAttribute[] = "store";
+constexpr char kStoreName[] = "secure-storage";
+
+const SecretSchema kSchema = {
+    "com.defyx.vpn.SecretCache",
+    SECRET_SCHEMA_NONE,
+    {
+        {kStoreAttribute, SECRET_SCHEMA_ATTRIBUTE_STRING},
+        {nullptr, SECRET_SCHEMA_ATTRIBUTE_STRING},
+    },
+};
+
+// Entries are serialised as "<length>:<key><length>:<value>" pairs so that
+// values can hold any character without escaping.
+bool ReadField(const char** cursor, const char* end, const char** field,
+               size_t* length) {
+  if (!g_ascii_isdigit(**cursor)) {
+    return false;
+  }
+  char* digits_end = nullptr;
+  errno = 0;
+  unsigned long long value = strtoull(*cursor, &digits_end, 10);
+  if (errno != 0 || digits_end == *cursor || digits_end >= end ||
+      *digits_end != ':' ||
+      value > static_cast<unsigned long long>(end - digits_end - 1)) {
+    return false;
+  }
+  *field = digits_end + 1;
+  *length = static_cast<size_t>(value);
+  *cursor = *field + *length;
+  return true;
+}
+
+void WriteField(char** cursor, const char* field, size_t length) {
+  *cursor += snprintf(*cursor, kMaxPrefixLength + 1, "%zu:", length);
+  memcpy(*cursor, field, length);
+  *cursor += length;
+}
+
+}  // namespace
+
+SecretCache::LockedBuffer::LockedBuffer(size_t length) : length_(length) {
+  size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  mapped_ = (length + 1 + page - 1) / page * page;
+  void* data = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data == MAP_FAILED) {
+    g_error("Failed to allocate %zu bytes for secrets", mapped_);
+  }
+  data_ = static_cast<char*>(data);
+
+  // Best effort; RLIMIT_MEMLOCK is usually enough for a few pages, and the
+  // secrets are no worse off than in the Dart heap if it is not.
+  static bool warned = false;
+  if (mlock(data_, mapped_) != 0 && !warned) {
+    warned = true;
+    g_warning("Failed to lock secret memory: %s", strerror(errno));
+  }
+  madvise(data_, mapped_, MADV_DONTDUMP);
+  data_[length] = '\0';
+}
+
+SecretCache::LockedBuffer::~LockedBuffer() {
+  explicit_bzero(data_, mapped_);
+  munlock(data_, mapped_);
+  munmap(data_, mapped_);
+}
+
+SecretCache::SecretCache() : cancellable_(g_cancellable_new()) {}
+
+SecretCache::~SecretCache() {
+  // A cancelled write-back may or may not have reached the keyring; write
+  // the latest state again to be sure.
+  if (storing_) {
+    dirty_ = true;
+  }
+  g_cancellable_cancel(cancellable_);
+  Flush();
+  g_clear_object(&cancellable_);
+}
+
+void SecretCache::Load() {
+  if (synced_ || loading_) {
+    return;
+  }
+  loading_ = true;
+  secret_password_lookup(&kSchema, cancellable_, OnLoaded, this,
+                         kStoreAttribute, kStoreName, nullptr);
+}
+
+void SecretCache::WhenLoaded(std::function<void()> callback) {
+  if (loaded_) {
+    callback();
+  } else {
+    pending_.push_back(std::move(callback));
+  }
+}
+
+const char* SecretCache::Lookup(const std::string& key) const {
+  auto it = entries_.find(key);
+  return it == entries_.end() ? nullptr : it->second->data();
+}
+
+void SecretCache::Store(const std::string& key, const char* value) {
+  size_t length = strlen(value);
+  std::unique_ptr<LockedBuffer> buffer(new LockedBuffer(length));
+  memcpy(buffer->data(), value, length);
+  entries_[key] = std::move(buffer);
+  removed_.erase(key);
+  ScheduleWriteBack();
+}
+
+void SecretCache::Remove(const std::string& key) {
+  // Until the keyring has been read it may hold |key| without the cache
+  // knowing.
+  bool removed = entries_.erase(key) > 0;
+  if (!synced_) {
+    removed_.insert(key);
+    removed = true;
+  }
+  if (removed) {
+    ScheduleWriteBack();
+  }
+}
+
+void SecretCache::Flush() {
+  if (write_back_id_ != 0) {
+    g_source_remove(write_back_id_);
+    write_back_id_ = 0;
+  }
+  if (!dirty_) {
+    return;
+  }
+  if (!synced_) {
+    g_warning("Discarding secret changes, the keyring could not be read");
+    return;
+  }
+  dirty_ = false;
+
+  std::unique_ptr<LockedBuffer> serialized = Serialize();
+  g_autoptr(GError) error = nullptr;
+  if (!secret_password_store_sync(&kSchema, SECRET_COLLECTION_DEFAULT, kLabel,
+                                  serialized->data(), nullptr, &error,
+                                  kStoreAttribute, kStoreName, nullptr)) {
+    g_warning("Failed to save secrets: %s", error->message);
+  }
+}
+
+// static
+void SecretCache::OnLoaded(GObject* object, GAsyncResult* result,
+                           gpointer user_data) {
+  g_autoptr(GError) error = nullptr;
+  gchar* serialized =
+      secret_password_lookup_nonpageable_finish(result, &error);
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    return;
+  }
+
+  SecretCache* self = static_cast<SecretCache*>(user_data);
+  self->loading_ = false;
+  if (error != nullptr) {
+    g_warning("Failed to load secrets, keeping changes in memory: %s",
+              error->message);
+  } else {
+    // A malformed item cannot be recovered; it is replaced like a missing
+    // one.
+    if (serialized != nullptr) {
+      if (!self->Parse(serialized)) {
+        g_warning("Ignoring malformed secrets");
+      }
+      secret_password_free(serialized);
+    }
+    self->synced_ = true;
+    self->removed_.clear();
+    if (self->dirty_) {
+      self->ScheduleWriteBack();
+    }
+  }
+
+  bool first_load = !self->loaded_;
+  self->loaded_ = true;
+  if (first_load) {
+    std::vector<std::function<void()>> pending;
+    pending.swap(self->pending_);
+    for (const auto& callback : pending) {
+      callback();
+    }
+  }
+}
+
+// static
+void SecretCache::OnStored(GObject* object, GAsyncResult* result,
+                           gpointer user_data) {
+  g_autoptr(GError) error = nullptr;
+  secret_password_store_finish(result, &error);
+  if (g_error_matches(error, G_IO_ERROR, G_IO_ERROR_CANCELLED)) {
+    return;
+  }
+
+  SecretCache* self = static_cast<SecretCache*>(user_data);
+  self->storing_ = false;
+  if (error != nullptr) {
+    g_warning("Failed to save secrets: %s", error->message);
+    self->dirty_ = true;
+  }
+  if (self->dirty_) {
+    self->ScheduleWriteBack();
+  }
+}
+
+// static
+gboolean SecretCache::OnWriteBackDue(gpointer user_data) {
+  SecretCache* self = static_cast<SecretCache*>(user_data);
+  self->write_back_id_ = 0;
+  self->StartWriteBack();
+  return G_SOURCE_REMOVE;
+}
+
+bool SecretCache::Parse(const char* serialized) {
+  const char* cursor = serialized;
+  const char* end = serialized + strlen(serialized);
+  while (cursor < end) {
+    const char* key;
+    size_t key_length;
+    const char* value;
+    size_t value_length;
+    if (!ReadField(&cursor, end, &key, &key_length) ||
+        !ReadField(&cursor, end, &value, &value_length)) {
+      return false;
+    }
+
+    std::string name(key, key_length);
+    if (entries_.count(name) > 0 || removed_.count(name) > 0) {
+      continue;
+    }
+    std::unique_ptr<LockedBuffer> buffer(new LockedBuffer(value_length));
+    memcpy(buffer->data(), value, value_length);
+    entries_[name] = std::move(buffer);
+  }
+  return true;
+}
+
+std::unique_ptr<SecretCache::LockedBuffer> SecretCache::Serialize() const {
+  size_t length = 0;
+  for (const auto& entry : entries_) {
+    length +=
+        entry.first.size() + entry.second->length() + 2 * kMaxPrefixLength;
+  }
+
+  std::unique_ptr<LockedBuffer> buffer(new LockedBuffer(length));
+  char* cursor = buffer->data();
+  for (const auto& entry : entries_) {
+    WriteField(&cursor, entry.first.data(), entry.first.size());
+    WriteField(&cursor, entry.second->data(), entry.second->length());
+  }
+  *cursor = '\0';
+  return buffer;
+}
+
+void SecretCache::ScheduleWriteBack() {
+  dirty_ = true;
+  if (!synced_) {
+    // Writes back once the read succeeds.
+    Load();
+    return;
+  }
+  if (write_back_id_ == 0 && !storing_) {
+    write_back_id_ = g_timeout_add(kWriteBackDelayMs, OnWriteBackDue, this);
+  }
+}
+
+void SecretCache::StartWriteBack() {
+  if (!dirty_ || storing_) {
+    return;
+  }
+  dirty_ = false;
+  storing_ = true;
+
+  // libsecret copies the password into its own non-pageable memory before
+  // returning, so the serialised form can be wiped right away.
+  std::unique_ptr<LockedBuffer> serialized = Serialize();
+  secret_password_store(&kSchema, SECRET_COLLECTION_DEFAULT, kLabel,
+                        serialized->data(), cancellable_, OnStored, this,
+                        kStoreAttribute, kStoreName, nullptr);
+}
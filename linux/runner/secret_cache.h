@@ -0,0 +1,108 @@
+#ifndef RUNNER_SECRET_CACHE_H_
+#define RUNNER_SECRET_CACHE_H_
+
+#include <gio/gio.h>
+#include <stddef.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Keeps the app's secure-storage entries in memory so reads and writes on
+// the connect path never wait on the keyring.
+//
+// All entries live in a single Secret Service item that is read once, when
+// Load() is called at startup. Values are held in mlock()ed memory that is
+// left out of core dumps and wiped when freed. Changes are written back in
+// the background, coalesced over a short delay so a burst of writes becomes
+// one keyring round trip, and any change still pending is written
+// synchronously when the cache is destroyed.
+//
+// The keyring item is only ever overwritten after it has been read, since
+// it holds every entry. If reading fails, e.g. because the keyring stays
+// locked, the cache serves what it has and reads again on the next change;
+// entries found then are merged in before anything is written back.
+//
+// Runs on the main context it was created on.
+class SecretCache {
+ public:
+  SecretCache();
+  ~SecretCache();
+
+  SecretCache(const SecretCache&) = delete;
+  SecretCache& operator=(const SecretCache&) = delete;
+
+  // Starts reading the entries from the keyring, unless they have been read
+  // already or are being read.
+  void Load();
+
+  // Runs |callback| once loading has finished, whether or not it succeeded;
+  // immediately if it already has.
+  void WhenLoaded(std::function<void()> callback);
+  bool loaded() const { return loaded_; }
+  // Whether the keyring has been read. Until then the cache only holds what
+  // was stored this session.
+  bool synced() const { return synced_; }
+
+  // Returns the cached value of |key|, or nullptr if there is none. The
+  // pointer is valid until |key| is next written or removed.
+  const char* Lookup(const std::string& key) const;
+
+  void Store(const std::string& key, const char* value);
+  void Remove(const std::string& key);
+
+ private:
+  // A nul-terminated string in locked, non-dumpable memory.
+  class LockedBuffer {
+   public:
+    explicit LockedBuffer(size_t length);
+    ~LockedBuffer();
+
+    LockedBuffer(const LockedBuffer&) = delete;
+    LockedBuffer& operator=(const LockedBuffer&) = delete;
+
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    size_t length() const { return length_; }
+
+   private:
+    char* data_ = nullptr;
+    size_t length_ = 0;
+    size_t mapped_ = 0;
+  };
+
+  static void OnLoaded(GObject* object, GAsyncResult* result,
+                       gpointer user_data);
+  static void OnStored(GObject* object, GAsyncResult* result,
+                       gpointer user_data);
+  static gboolean OnWriteBackDue(gpointer user_data);
+
+  // Adds the entries in |serialized| that are neither cached nor removed.
+  bool Parse(const char* serialized);
+  std::unique_ptr<LockedBuffer> Serialize() const;
+
+  void ScheduleWriteBack();
+  void StartWriteBack();
+
+  // Writes pending changes to the keyring, blocking until done.
+  void Flush();
+
+  std::map<std::string, std::unique_ptr<LockedBuffer>> entries_;
+  bool loaded_ = false;
+  bool loading_ = false;
+  // The keyring has been read; only then may it be written.
+  bool synced_ = false;
+  // Keys removed before the keyring could be read.
+  std::set<std::string> removed_;
+  std::vector<std::function<void()>> pending_;
+
+  GCancellable* cancellable_ = nullptr;
+  guint write_back_id_ = 0;
+  bool dirty_ = false;
+  bool storing_ = false;
+};
+
+#endif  // RUNNER_SECRET_CACHE_H_
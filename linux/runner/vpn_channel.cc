@@ -0,0 +1,504 @@
+#include "vpn_channel.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+
+#include "control_socket.h"
+#include "history_store.h"
+#include "mtu_prober.h"
+#include "network_monitor.h"
+#include "secret_cache.h"
+
+// Runner-side counterpart of VpnBridge; methods the Linux runner does not
+// provide answer with notImplemented.
+static constexpr char kVpnChannel[] = "com.defyx.vpn";
+
+// Emits {"interface": <name>} whenever the physical network changes.
+static constexpr char kNetworkEventsChannel[] = "com.defyx.network_events";
+
+// Hands the headless daemon's control socket requests to Dart, which answers
+// connect, disconnect and status with a ControlSocket state and ping with a
+// round trip in ms.
+static constexpr char kDaemonChannel[] = "com.defyx.daemon";
+
+struct _VpnChannel {
+  GObject parent_instance;
+
+  FlMethodChannel* vpn_methods;
+  FlEventChannel* network_events;
+  NetworkMonitor* network_monitor;
+  HistoryStore* history;
+  MtuProber* mtu_prober;
+  // The probeMtu call waiting for the prober to finish.
+  FlMethodCall* mtu_probe_call;
+  SecretCache* secrets;
+  FlMethodChannel* daemon_methods;
+  ControlSocket* control_socket;
+};
+
+G_DEFINE_TYPE(VpnChannel, vpn_channel, G_TYPE_OBJECT)
+
+// Reads a numeric map entry as a float; missing or non-numeric values are NaN
+// so they are skipped by the history aggregates.
+static float lookup_float(FlValue* args, const char* key) {
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr) {
+    return NAN;
+  }
+  switch (fl_value_get_type(value)) {
+    case FL_VALUE_TYPE_INT:
+      return static_cast<float>(fl_value_get_int(value));
+    case FL_VALUE_TYPE_FLOAT:
+      return static_cast<float>(fl_value_get_float(value));
+    default:
+      return NAN;
+  }
+}
+
+static int64_t lookup_int(FlValue* args, const char* key,
+                          int64_t default_value) {
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_INT) {
+    return default_value;
+  }
+  return fl_value_get_int(value);
+}
+
+static std::string lookup_string(FlValue* args, const char* key) {
+  FlValue* value = fl_value_lookup_string(args, key);
+  if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+    return std::string();
+  }
+  return fl_value_get_string(value);
+}
+
+static FlValue* column_summary_to_value(const ColumnSummary& summary) {
+  FlValue* value = fl_value_new_map();
+  fl_value_set_string_take(value, "count", fl_value_new_int(summary.count));
+  fl_value_set_string_take(value, "min", fl_value_new_float(summary.min));
+  fl_value_set_string_take(value, "max", fl_value_new_float(summary.max));
+  fl_value_set_string_take(value, "mean", fl_value_new_float(summary.mean));
+  fl_value_set_string_take(value, "p50", fl_value_new_float(summary.p50));
+  fl_value_set_string_take(value, "p90", fl_value_new_float(summary.p90));
+  fl_value_set_string_take(value, "p99", fl_value_new_float(summary.p99));
+  return value;
+}
+
+// Opens the history store on first use so startup never touches the disk.
+static HistoryStore* vpn_channel_get_history(VpnChannel* self) {
+  if (self->history == nullptr) {
+    g_autofree gchar* directory = g_build_filename(
+        g_get_user_data_dir(), "defyx_vpn", "history", nullptr);
+    self->history = new HistoryStore(directory);
+  }
+  return self->history->Open() ? self->history : nullptr;
+}
+
+static FlMethodResponse* record_history(VpnChannel* self, FlValue* args) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "Expected a map of history fields", nullptr));
+  }
+
+  HistoryStore* history = vpn_channel_get_history(self);
+  if (history == nullptr) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "HISTORY_ERROR", "Failed to open history store", nullptr));
+  }
+
+  HistoryRecord record;
+  record.timestamp_ms = lookup_int(args, "timestamp", g_get_real_time() / 1000);
+  record.download_mbps = lookup_float(args, "download");
+  record.upload_mbps = lookup_float(args, "upload");
+  record.ping_ms = lookup_float(args, "ping");
+  record.jitter_ms = lookup_float(args, "jitter");
+  record.packet_loss = lookup_float(args, "packetLoss");
+  record.connect_ms = lookup_float(args, "connectMs");
+  record.method = lookup_string(args, "method");
+
+  if (!history->Append(record)) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "HISTORY_ERROR", "Failed to append history record", nullptr));
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+static FlMethodResponse* get_history_summary(VpnChannel* self, FlValue* args) {
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENTS", "Expected from, to and method", nullptr));
+  }
+
+  HistoryStore* history = vpn_channel_get_history(self);
+  if (history == nullptr) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "HISTORY_ERROR", "Failed to open history store", nullptr));
+  }
+
+  HistorySummary summary = history->Summarize(
+      lookup_int(args, "from", 0), lookup_int(args, "to", INT64_MAX),
+      lookup_string(args, "method"));
+
+  g_autoptr(FlValue) result = fl_value_new_map();
+  fl_value_set_string_take(result, "rows", fl_value_new_int(summary.rows));
+  fl_value_set_string_take(result, "download",
+                           column_summary_to_value(summary.download_mbps));
+  fl_value_set_string_take(result, "upload",
+                           column_summary_to_value(summary.upload_mbps));
+  fl_value_set_string_take(result, "ping",
+                           column_summary_to_value(summary.ping_ms));
+  fl_value_set_string_take(result, "jitter",
+                           column_summary_to_value(summary.jitter_ms));
+  fl_value_set_string_take(result, "packetLoss",
+                           column_summary_to_value(summary.packet_loss));
+  fl_value_set_string_take(result, "connectMs",
+                           column_summary_to_value(summary.connect_ms));
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+}
+
+static void vpn_channel_respond(FlMethodCall* method_call,
+                                FlMethodResponse* response) {
+  g_autoptr(GError) error = nullptr;
+  if (!fl_method_call_respond(method_call, response, &error)) {
+    g_warning("Failed to send response to %s: %s",
+              fl_method_call_get_name(method_call), error->message);
+  }
+}
+
+static void mtu_probe_done(VpnChannel* self, const MtuProber::Result& result,
+                           const std::string& error) {
+  g_autoptr(FlMethodCall) method_call = self->mtu_probe_call;
+  self->mtu_probe_call = nullptr;
+
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (!error.empty()) {
+    response = FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "MTU_PROBE_FAILED", error.c_str(), nullptr));
+  } else {
+    g_autoptr(FlValue) value = fl_value_new_map();
+    fl_value_set_string_take(value, "interface",
+                             fl_value_new_string(result.interface.c_str()));
+    fl_value_set_string_take(value, "mtu", fl_value_new_int(result.mtu));
+    fl_value_set_string_take(value, "mss", fl_value_new_int(result.mss));
+    fl_value_set_string_take(value, "probes", fl_value_new_int(result.probes));
+    fl_value_set_string_take(value, "applied",
+                             fl_value_new_bool(result.applied));
+    response = FL_METHOD_RESPONSE(fl_method_success_response_new(value));
+  }
+  vpn_channel_respond(method_call, response);
+}
+
+// Answers once probing has finished, which takes up to a few seconds.
+static void probe_mtu(VpnChannel* self, FlMethodCall* method_call,
+                      FlValue* args) {
+  if (self->mtu_prober->running()) {
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "MTU_PROBE_BUSY", "An MTU probe is already running", nullptr));
+    vpn_channel_respond(method_call, response);
+    return;
+  }
+
+  MtuProber::Options options;
+  if (args != nullptr && fl_value_get_type(args) == FL_VALUE_TYPE_MAP) {
+    std::string target = lookup_string(args, "target");
+    if (!target.empty()) {
+      options.target = target;
+    }
+    options.floor = static_cast<int>(lookup_int(args, "floor", options.floor));
+    options.ceiling =
+        static_cast<int>(lookup_int(args, "ceiling", options.ceiling));
+    options.hint = static_cast<int>(lookup_int(args, "hint", options.hint));
+  }
+
+  self->mtu_probe_call = FL_METHOD_CALL(g_object_ref(method_call));
+  self->mtu_prober->Start(options, [self](const MtuProber::Result& result,
+                                          const std::string& error) {
+    mtu_probe_done(self, result, error);
+  });
+}
+
+// Called when the tunnel goes away; a probe finishing later would retune
+// whatever interface has taken its place.
+static FlMethodResponse* cancel_mtu_probe(VpnChannel* self) {
+  if (self->mtu_prober->running()) {
+    self->mtu_prober->Cancel();
+
+    g_autoptr(FlMethodCall) method_call = self->mtu_probe_call;
+    self->mtu_probe_call = nullptr;
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_error_response_new(
+            "MTU_PROBE_CANCELLED", "The MTU probe was cancelled", nullptr));
+    vpn_channel_respond(method_call, response);
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+static FlMethodResponse* handle_secret_call(VpnChannel* self,
+                                            FlMethodCall* method_call) {
+  const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
+  if (args == nullptr || fl_value_get_type(args) != FL_VALUE_TYPE_MAP) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "Expected a map", nullptr));
+  }
+  std::string key = lookup_string(args, "key");
+  if (key.empty()) {
+    return FL_METHOD_RESPONSE(fl_method_error_response_new(
+        "INVALID_ARGUMENT", "Missing key", nullptr));
+  }
+
+  if (strcmp(method, "readSecret") == 0) {
+    const char* value = self->secrets->Lookup(key);
+    g_autoptr(FlValue) result =
+        value != nullptr ? fl_value_new_string(value) : fl_value_new_null();
+    return FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+  }
+  if (strcmp(method, "writeSecret") == 0) {
+    FlValue* value = fl_value_lookup_string(args, "value");
+    if (value == nullptr || fl_value_get_type(value) != FL_VALUE_TYPE_STRING) {
+      return FL_METHOD_RESPONSE(fl_method_error_response_new(
+          "INVALID_ARGUMENT", "Missing value", nullptr));
+    }
+    self->secrets->Store(key, fl_value_get_string(value));
+  } else {
+    self->secrets->Remove(key);
+  }
+  return FL_METHOD_RESPONSE(fl_method_success_response_new(nullptr));
+}
+
+// Secret calls made before the keyring has been read at startup are answered
+// once it has.
+static void secret_call(VpnChannel* self, FlMethodCall* method_call) {
+  std::shared_ptr<FlMethodCall> call(FL_METHOD_CALL(g_object_ref(method_call)),
+                                     g_object_unref);
+  self->secrets->WhenLoaded([self, call]() {
+    g_autoptr(FlMethodResponse) response = handle_secret_call(self, call.get());
+    vpn_channel_respond(call.get(), response);
+  });
+}
+
+// Answers once the keyring has been read at startup, with whether it could
+// be.
+static void secret_cache_synced(VpnChannel* self, FlMethodCall* method_call) {
+  std::shared_ptr<FlMethodCall> call(FL_METHOD_CALL(g_object_ref(method_call)),
+                                     g_object_unref);
+  self->secrets->WhenLoaded([self, call]() {
+    g_autoptr(FlValue) result = fl_value_new_bool(self->secrets->synced());
+    g_autoptr(FlMethodResponse) response =
+        FL_METHOD_RESPONSE(fl_method_success_response_new(result));
+    vpn_channel_respond(call.get(), response);
+  });
+}
+
+static void vpn_method_call_cb(FlMethodChannel* channel,
+                               FlMethodCall* method_call, gpointer user_data) {
+  VpnChannel* self = VPN_CHANNEL(user_data);
+  const gchar* method = fl_method_call_get_name(method_call);
+  FlValue* args = fl_method_call_get_args(method_call);
+
+  if (strcmp(method, "probeMtu") == 0) {
+    probe_mtu(self, method_call, args);
+    return;
+  }
+  if (strcmp(method, "readSecret") == 0 ||
+      strcmp(method, "writeSecret") == 0 ||
+      strcmp(method, "deleteSecret") == 0) {
+    secret_call(self, method_call);
+    return;
+  }
+  if (strcmp(method, "isSecretCacheSynced") == 0) {
+    secret_cache_synced(self, method_call);
+    return;
+  }
+
+  g_autoptr(FlMethodResponse) response = nullptr;
+  if (strcmp(method, "recordHistory") == 0) {
+    response = record_history(self, args);
+  } else if (strcmp(method, "getHistorySummary") == 0) {
+    response = get_history_summary(self, args);
+  } else if (strcmp(method, "cancelMtuProbe") == 0) {
+    response = cancel_mtu_probe(self);
+  } else {
+    response = FL_METHOD_RESPONSE(fl_method_not_implemented_response_new());
+  }
+  vpn_channel_respond(method_call, response);
+}
+
+static void vpn_channel_send_network_change(VpnChannel* self,
+                                            const std::string& interface) {
+  g_autoptr(FlValue) event = fl_value_new_map();
+  fl_value_set_string_take(event, "interface",
+                           fl_value_new_string(interface.c_str()));
+
+  g_autoptr(GError) error = nullptr;
+  if (!fl_event_channel_send(self->network_events, event, nullptr, &error)) {
+    g_warning("Failed to send network change: %s", error->message);
+  }
+}
+
+static FlMethodErrorResponse* network_events_listen_cb(FlEventChannel* channel,
+                                                       FlValue* args,
+                                                       gpointer user_data) {
+  VpnChannel* self = VPN_CHANNEL(user_data);
+  if (!self->network_monitor->Start()) {
+    return fl_method_error_response_new(
+        "NETLINK_ERROR", "Failed to watch network changes", nullptr);
+  }
+  return nullptr;
+}
+
+static FlMethodErrorResponse* network_events_cancel_cb(FlEventChannel* channel,
+                                                       FlValue* args,
+                                                       gpointer user_data) {
+  VpnChannel* self = VPN_CHANNEL(user_data);
+  self->network_monitor->Stop();
+  return nullptr;
+}
+
+// A control socket request waiting for Dart to answer.
+struct DaemonRequest {
+  ControlSocket::Command command;
+  ControlSocket::Reply reply;
+};
+
+static void daemon_request_done_cb(GObject* object, GAsyncResult* result,
+                                   gpointer user_data) {
+  std::unique_ptr<DaemonRequest> request(
+      static_cast<DaemonRequest*>(user_data));
+
+  g_autoptr(GError) error = nullptr;
+  g_autoptr(FlMethodResponse) response = fl_method_channel_invoke_method_finish(
+      FL_METHOD_CHANNEL(object), result, &error);
+  FlValue* value = response != nullptr
+                       ? fl_method_response_get_result(response, &error)
+                       : nullptr;
+  if (value == nullptr) {
+    request->reply(ControlSocket::kFailed, error->message);
+    return;
+  }
+  if (fl_value_get_type(value) != FL_VALUE_TYPE_INT) {
+    request->reply(ControlSocket::kFailed, "Unexpected result");
+    return;
+  }
+
+  int64_t answer = fl_value_get_int(value);
+  std::string payload;
+  if (request->command == ControlSocket::kPing) {
+    uint32_t ms = static_cast<uint32_t>(CLAMP(answer, 0, G_MAXUINT32));
+    for (int shift = 0; shift < 32; shift += 8) {
+      payload.push_back(static_cast<char>((ms >> shift) & 0xff));
+    }
+  } else {
+    payload.push_back(static_cast<char>(answer));
+  }
+  request->reply(ControlSocket::kOk, payload);
+}
+
+static void daemon_request_cb(VpnChannel* self, ControlSocket::Command command,
+                              ControlSocket::Reply reply) {
+  const char* method = nullptr;
+  switch (command) {
+    case ControlSocket::kConnect:
+      method = "connect";
+      break;
+    case ControlSocket::kDisconnect:
+      method = "disconnect";
+      break;
+    case ControlSocket::kStatus:
+      method = "status";
+      break;
+    case ControlSocket::kPing:
+      method = "ping";
+      break;
+  }
+  fl_method_channel_invoke_method(self->daemon_methods, method, nullptr,
+                                  nullptr, daemon_request_done_cb,
+                                  new DaemonRequest{command, std::move(reply)});
+}
+
+static void vpn_channel_dispose(GObject* object) {
+  VpnChannel* self = VPN_CHANNEL(object);
+
+  if (self->network_monitor != nullptr) {
+    delete self->network_monitor;
+    self->network_monitor = nullptr;
+  }
+  if (self->history != nullptr) {
+    delete self->history;
+    self->history = nullptr;
+  }
+  if (self->mtu_prober != nullptr) {
+    delete self->mtu_prober;
+    self->mtu_prober = nullptr;
+  }
+  g_clear_object(&self->mtu_probe_call);
+  // Writes back any secrets changed in the last moments before exit.
+  if (self->secrets != nullptr) {
+    delete self->secrets;
+    self->secrets = nullptr;
+  }
+  if (self->control_socket != nullptr) {
+    delete self->control_socket;
+    self->control_socket = nullptr;
+  }
+  g_clear_object(&self->vpn_methods);
+  g_clear_object(&self->network_events);
+  g_clear_object(&self->daemon_methods);
+
+  G_OBJECT_CLASS(vpn_channel_parent_class)->dispose(object);
+}
+
+static void vpn_channel_class_init(VpnChannelClass* klass) {
+  G_OBJECT_CLASS(klass)->dispose = vpn_channel_dispose;
+}
+
+static void vpn_channel_init(VpnChannel* self) {
+  self->network_monitor = new NetworkMonitor(
+      [self](const std::string& interface) {
+        vpn_channel_send_network_change(self, interface);
+      });
+  self->mtu_prober = new MtuProber();
+  self->secrets = new SecretCache();
+}
+
+VpnChannel* vpn_channel_new(FlBinaryMessenger* messenger) {
+  VpnChannel* self =
+      VPN_CHANNEL(g_object_new(vpn_channel_get_type(), nullptr));
+
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+  self->vpn_methods =
+      fl_method_channel_new(messenger, kVpnChannel, FL_METHOD_CODEC(codec));
+  fl_method_channel_set_method_call_handler(self->vpn_methods,
+                                            vpn_method_call_cb, self, nullptr);
+
+  self->network_events = fl_event_channel_new(messenger, kNetworkEventsChannel,
+                                              FL_METHOD_CODEC(codec));
+  fl_event_channel_set_stream_handlers(self->network_events,
+                                       network_events_listen_cb,
+                                       network_events_cancel_cb, self, nullptr);
+
+  // Read the keyring now so the first connect does not wait on it.
+  self->secrets->Load();
+
+  return self;
+}
+
+gboolean vpn_channel_start_control_socket(VpnChannel* self,
+                                          FlBinaryMessenger* messenger,
+                                          const gchar* path) {
+  g_return_val_if_fail(self->control_socket == nullptr, FALSE);
+
+  g_autoptr(FlStandardMethodCodec) codec = fl_standard_method_codec_new();
+  self->daemon_methods =
+      fl_method_channel_new(messenger, kDaemonChannel, FL_METHOD_CODEC(codec));
+
+  self->control_socket = new ControlSocket(
+      path, [self](ControlSocket::Command command, ControlSocket::Reply reply) {
+        daemon_request_cb(self, command, std::move(reply));
+      });
+  return self->control_socket->Start();
+}
@@ -0,0 +1,35 @@
+#ifndef RUNNER_VPN_CHANNEL_H_
+#define RUNNER_VPN_CHANNEL_H_
+
+#include <flutter_linux/flutter_linux.h>
+
+G_DECLARE_FINAL_TYPE(VpnChannel, vpn_channel, VPN, CHANNEL, GObject)
+
+/**
+ * vpn_channel_new:
+ * @messenger: the #FlBinaryMessenger of the running engine.
+ *
+ * Registers the runner's native com.defyx.* channels on @messenger. The
+ * channels stay registered for as long as the returned object is alive.
+ *
+ * Returns: a new #VpnChannel.
+ */
+VpnChannel* vpn_channel_new(FlBinaryMessenger* messenger);
+
+/**
+ * vpn_channel_start_control_socket:
+ * @channel: a #VpnChannel.
+ * @messenger: the #FlBinaryMessenger @channel was created with.
+ * @path: where to create the socket.
+ *
+ * Serves the headless daemon's control socket at @path, forwarding its
+ * requests to Dart over the com.defyx.daemon channel. See control_socket.h
+ * for the protocol.
+ *
+ * Returns: %TRUE if the socket is listening.
+ */
+gboolean vpn_channel_start_control_socket(VpnChannel* channel,
+                                          FlBinaryMessenger* messenger,
+                                          const gchar* path);
+
+#endif  // RUNNER_VPN_CHANNEL_H_
@@ -0,0 +1,97 @@
+#!/bin/bash
+#
+# Measures TCP goodput at each tunnel MTU over a local path between two
+# network namespaces, to show what the Linux runner's MTU prober gains over
+# the fixed 1280. The link is shaped with tbf and charges every packet a
+# fixed encapsulation overhead, the way the tunnel's outer headers cost
+# bandwidth on the physical path.
+#
+# Usage: sudo scripts/mtu_goodput_bench.sh [rate] [overhead] [seconds] [mtu...]
+#   rate      shaped link rate in tc syntax (default 100mbit)
+#   overhead  bytes of encapsulation per packet (default 60, WireGuard over
+#             IPv4: outer IP, UDP and WireGuard headers)
+#   seconds   length of each transfer (default 5)
+#   mtu       tunnel MTUs to measure (default 1280 1360 1420 1500)
+#
+# Needs root, iproute2 with tbf and python3.
+
+set -euo pipefail
+
+RATE=${1:-100mbit}
+OVERHEAD=${2:-60}
+SECONDS_PER_RUN=${3:-5}
+if [ $# -gt 3 ]; then
+    MTUS=("${@:4}")
+else
+    MTUS=(1280 1360 1420 1500)
+fi
+
+SENDER=defyx-bench-tx
+RECEIVER=defyx-bench-rx
+PORT=5201
+
+cleanup() {
+    ip netns del "$SENDER" 2>/dev/null || true
+    ip netns del "$RECEIVER" 2>/dev/null || true
+}
+trap cleanup EXIT
+
+cleanup
+ip netns add "$SENDER"
+ip netns add "$RECEIVER"
+ip link add tx0 netns "$SENDER" type veth peer name rx0 netns "$RECEIVER"
+ip -n "$SENDER" addr add 10.201.0.1/24 dev tx0
+ip -n "$RECEIVER" addr add 10.201.0.2/24 dev rx0
+ip -n "$SENDER" link set lo up
+ip -n "$RECEIVER" link set lo up
+ip -n "$SENDER" link set tx0 up
+ip -n "$RECEIVER" link set rx0 up
+# Segmentation offloads would hand tbf packets larger than the MTU.
+ip -n "$SENDER" link set tx0 gso_max_segs 1
+ip netns exec "$SENDER" tc qdisc add dev tx0 root tbf rate "$RATE" \
+    burst 32k latency 50ms overhead "$OVERHEAD"
+
+# Prints the goodput in Mbit/s of one transfer of SECONDS_PER_RUN seconds.
+measure() {
+    ip netns exec "$RECEIVER" python3 - "$PORT" <<'EOF' &
+import socket, sys, time
+server = socket.socket()
+server.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+server.bind(("10.201.0.2", int(sys.argv[1])))
+server.listen(1)
+connection, _ = server.accept()
+received = 0
+start = time.monotonic()
+while True:
+    data = connection.recv(1 << 20)
+    if not data:
+        break
+    received += len(data)
+elapsed = time.monotonic() - start
+print("%.1f" % (received * 8 / elapsed / 1e6))
+EOF
+    local receiver=$!
+    sleep 0.5
+    ip netns exec "$SENDER" python3 - "$PORT" "$SECONDS_PER_RUN" <<'EOF'
+import socket, sys, time
+client = socket.create_connection(("10.201.0.2", int(sys.argv[1])))
+chunk = bytes(1 << 16)
+deadline = time.monotonic() + float(sys.argv[2])
+while time.monotonic() < deadline:
+    client.sendall(chunk)
+client.close()
+EOF
+    wait "$receiver"
+}
+
+echo "Link $RATE, $OVERHEAD bytes of encapsulation per packet"
+printf "%6s %6s %14s %10s\n" MTU MSS "goodput Mbit/s" "vs first"
+baseline=""
+for mtu in "${MTUS[@]}"; do
+    ip -n "$SENDER" link set tx0 mtu "$mtu"
+    ip -n "$RECEIVER" link set rx0 mtu "$mtu"
+    goodput=$(measure)
+    baseline=${baseline:-$goodput}
+    printf "%6d %6d %14s %9s%%\n" "$mtu" $((mtu - 40)) "$goodput" \
+        "$(python3 -c "print('%+.1f' % (($goodput / $baseline - 1) * 100))")"
+done
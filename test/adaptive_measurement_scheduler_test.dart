@@ -0,0 +1,126 @@
+import 'dart:math';
+
+import 'package:flutter_test/flutter_test.dart';
+
+import 'package:defyx_vpn/modules/speed_test/application/services/adaptive_measurement_scheduler.dart';
+import 'package:defyx_vpn/modules/speed_test/application/services/speed_measurement_config.dart';
+
+// A shaped link: each stream gets at most [perStreamMbps], all of them
+// together at most [capacityMbps].
+class _Link {
+  final double capacityMbps;
+  final double perStreamMbps;
+
+  _Link(this.capacityMbps, {double? perStreamMbps})
+      : perStreamMbps = perStreamMbps ?? capacityMbps;
+
+  double throughput(int streams) => min(capacityMbps, perStreamMbps * streams);
+
+  Duration transferTime(int bytes, int streams) =>
+      Duration(microseconds: (bytes * 8 / throughput(streams)).round());
+}
+
+AdaptiveMeasurementScheduler _scheduler({
+  Duration budget = const Duration(minutes: 1),
+  int maxBytes = SpeedMeasurementConfig.maxDownloadBytes,
+}) {
+  return AdaptiveMeasurementScheduler(
+    budget: budget,
+    initialBytes: SpeedMeasurementConfig.initialTransferBytes,
+    maxBytes: maxBytes,
+  );
+}
+
+// Feeds samples from [link] until the scheduler stops, or [maxSamples] as a
+// guard against a scheduler that never converges.
+void _run(AdaptiveMeasurementScheduler scheduler, _Link link,
+    {int maxSamples = 50}) {
+  var samples = 0;
+  while (scheduler.hasNext && samples++ < maxSamples) {
+    final streams = scheduler.streams;
+    scheduler.record(link.throughput(streams),
+        link.transferTime(scheduler.bytes, streams));
+  }
+}
+
+void main() {
+  test('grows the transfer until samples leave slow start', () {
+    final scheduler = _scheduler();
+    final link = _Link(100);
+
+    final sizes = <int>[];
+    while (scheduler.steadySamples.isEmpty) {
+      sizes.add(scheduler.bytes);
+      scheduler.record(100, link.transferTime(scheduler.bytes, 1));
+    }
+
+    // Short samples grow the transfer by up to 8x towards the target
+    // duration; the first sample long enough to trust is kept.
+    expect(sizes, [100000, 800000, 6400000, 25000000]);
+    expect(scheduler.allSamples, hasLength(4));
+    expect(scheduler.steadySamples, [100.0]);
+    expect(link.transferTime(scheduler.bytes, 1),
+        SpeedMeasurementConfig.targetSampleDuration);
+  });
+
+  test('stops adding streams once they stop helping', () {
+    final scheduler = _scheduler();
+    _run(scheduler, _Link(100));
+
+    // One stream fills the path, so the first doubling gains nothing.
+    expect(scheduler.converged, isTrue);
+    expect(scheduler.streams, 2);
+    expect(scheduler.resultSamples, everyElement(100.0));
+  });
+
+  test('keeps doubling streams while they raise throughput', () {
+    final scheduler = _scheduler();
+    _run(scheduler, _Link(40, perStreamMbps: 30));
+
+    expect(scheduler.converged, isTrue);
+    expect(scheduler.streams, 4);
+    expect(scheduler.steadySamples.reduce(max), 40);
+  });
+
+  test('never uses more than the maximum number of streams', () {
+    final scheduler = _scheduler();
+    _run(scheduler, _Link(1000, perStreamMbps: 30));
+
+    expect(scheduler.converged, isTrue);
+    expect(scheduler.streams, SpeedMeasurementConfig.maxStreams);
+  });
+
+  test('ends the phase when the budget is spent', () async {
+    final scheduler = _scheduler(budget: const Duration(milliseconds: 50));
+    final link = _Link(10);
+
+    expect(scheduler.hasNext, isTrue);
+    scheduler.record(10, link.transferTime(scheduler.bytes, 1));
+    await Future<void>.delayed(const Duration(milliseconds: 60));
+
+    expect(scheduler.hasNext, isFalse);
+    expect(scheduler.converged, isFalse);
+    expect(scheduler.progress, 1.0);
+    expect(scheduler.remaining, Duration.zero);
+    // No sample was long enough to trust; report what was measured.
+    expect(scheduler.steadySamples, isEmpty);
+    expect(scheduler.resultSamples, [10.0]);
+  });
+
+  test('trusts short samples once the transfer is at its maximum', () {
+    final scheduler = _scheduler(maxBytes: 200000);
+    final link = _Link(1000);
+    _run(scheduler, link);
+
+    // Every sample is far below the minimum duration, but once taken at the
+    // largest transfer they cannot get any longer. The first one, taken
+    // while the transfer could still grow, is not trusted.
+    expect(link.transferTime(200000, 1),
+        lessThan(SpeedMeasurementConfig.minSampleDuration));
+    expect(scheduler.bytes, 200000);
+    expect(scheduler.allSamples, hasLength(6));
+    expect(scheduler.steadySamples, hasLength(5));
+    expect(scheduler.steadySamples, scheduler.allSamples.sublist(1));
+    expect(scheduler.converged, isTrue);
+  });
+}